@@ -1,4 +1,6 @@
 #include "application.h"
+#include "gl_state_cache.h"
+#include "glsl_program.h"
 
 Application::Application(const Options& options)
     : _assetRootDir(options.assetRootDir), _windowTitle(options.windowTitle),
@@ -49,6 +51,18 @@ Application::Application(const Options& options)
         throw std::runtime_error("glad initialization OpenGL failure");
     }
 
+    // glad loads the entry points of core versions only, program binaries are core
+    // since 4.1 but widely offered as an extension to 3.3 contexts
+    if (!GLAD_GL_VERSION_4_1 && hasGLExtension("GL_ARB_get_program_binary")) {
+        glad_glGetProgramBinary =
+            (PFNGLGETPROGRAMBINARYPROC)glfwGetProcAddress("glGetProgramBinary");
+        glad_glProgramBinary = (PFNGLPROGRAMBINARYPROC)glfwGetProcAddress("glProgramBinary");
+        glad_glProgramParameteri =
+            (PFNGLPROGRAMPARAMETERIPROC)glfwGetProcAddress("glProgramParameteri");
+    }
+
+    GLSLProgram::setBinaryCacheDirectory(options.shaderCacheDir);
+
     std::cout << "OpenGL\n";
     std::cout << "+ version:    " << glGetString(GL_VERSION) << '\n';
     std::cout << "+ renderer:   " << glGetString(GL_RENDERER) << '\n';
@@ -60,7 +74,7 @@ Application::Application(const Options& options)
     glViewport(0, 0, _windowWidth, _windowHeight);
 
     if (options.msaa) {
-        glEnable(GL_MULTISAMPLE);
+        GLStateCache::instance().setEnabled(GL_MULTISAMPLE, true);
     }
 
     // callback functions
@@ -87,6 +101,7 @@ void Application::run() {
     while (!glfwWindowShouldClose(_window)) {
         updateTime();
         handleInput();
+        GLStateCache::instance().beginFrame();
         renderFrame();
 
         glfwSwapBuffers(_window);
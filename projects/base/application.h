@@ -23,6 +23,7 @@ struct Options {
     bool msaa;
     std::pair<int, int> glVersion;
     glm::vec4 backgroundColor;
+    std::string shaderCacheDir; // program binaries are cached here, empty to compile always
 };
 
 class Application {
@@ -13,4 +13,22 @@ struct BoundingBox {
 
         return *this;
     }
+
+    // axis aligned box enclosing the 8 transformed corners
+    BoundingBox transform(const glm::mat4& matrix) const {
+        const glm::vec3 corners[8] = {
+            glm::vec3(min.x, min.y, min.z), glm::vec3(min.x, min.y, max.z),
+            glm::vec3(min.x, max.y, min.z), glm::vec3(min.x, max.y, max.z),
+            glm::vec3(max.x, min.y, min.z), glm::vec3(max.x, min.y, max.z),
+            glm::vec3(max.x, max.y, min.z), glm::vec3(max.x, max.y, max.z)};
+
+        BoundingBox transformed;
+        for (int i = 0; i < 8; ++i) {
+            glm::vec4 point = matrix * glm::vec4(corners[i], 1.0f);
+            transformed.min = glm::min(transformed.min, glm::vec3(point));
+            transformed.max = glm::max(transformed.max, glm::vec3(point));
+        }
+
+        return transformed;
+    }
 };
\ No newline at end of file
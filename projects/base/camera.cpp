@@ -1,3 +1,5 @@
+#include <cmath>
+
 #include "camera.h"
 
 glm::mat4 Camera::getViewMatrix() const {
@@ -14,12 +16,26 @@ glm::mat4 PerspectiveCamera::getProjectionMatrix() const {
 
 Frustum PerspectiveCamera::getFrustum() const {
     Frustum frustum;
-    // TODO: construct the frustum with the position and orientation of the camera
-    // Note: this is for Bonus project 'Frustum Culling'
-    // write your code here
-    // ----------------------------------------------------------------------
-    // ...
-    // ----------------------------------------------------------------------
+    const glm::vec3 fv = transform.getFront();
+    const glm::vec3 rv = transform.getRight();
+    const glm::vec3 uv = transform.getUp();
+
+    // edges of the far face seen from the camera, the side planes contain them
+    const float halfHeight = zfar * std::tan(fovy * 0.5f);
+    const float halfWidth = halfHeight * aspect;
+    const glm::vec3 farCenter = zfar * fv;
+
+    // all of the plane normal points inside the frustum
+    frustum.planes[Frustum::NearFace] = {transform.position + znear * fv, fv};
+    frustum.planes[Frustum::FarFace] = {transform.position + farCenter, -fv};
+    frustum.planes[Frustum::LeftFace] = {
+        transform.position, glm::cross(farCenter - halfWidth * rv, uv)};
+    frustum.planes[Frustum::RightFace] = {
+        transform.position, glm::cross(uv, farCenter + halfWidth * rv)};
+    frustum.planes[Frustum::BottomFace] = {
+        transform.position, glm::cross(rv, farCenter - halfHeight * uv)};
+    frustum.planes[Frustum::TopFace] = {
+        transform.position, glm::cross(farCenter + halfHeight * uv, rv)};
 
     return frustum;
 }
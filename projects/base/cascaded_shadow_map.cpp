@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "cascaded_shadow_map.h"
+#include "gl_state_cache.h"
+
+constexpr int CascadedShadowMap::maxCascades;
+constexpr float CascadedShadowMap::casterDistance;
+
+CascadedShadowMap::CascadedShadowMap(int resolution, int cascadeCount, float shadowDistance)
+    : _resolution(resolution), _shadowDistance(shadowDistance),
+      _cascades(std::min(std::max(cascadeCount, 1), maxCascades)),
+      _depthLayers(
+          GL_DEPTH_COMPONENT24, resolution, resolution,
+          2 * std::min(std::max(cascadeCount, 1), maxCascades), GL_DEPTH_COMPONENT, GL_FLOAT) {
+    // hardware 2x2 percentage closer filtering
+    _depthLayers.bind(0);
+    _depthLayers.setParamterInt(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    _depthLayers.setParamterInt(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    _depthLayers.setParamterInt(GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    _depthLayers.setParamterInt(GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+    const int count = static_cast<int>(_cascades.size());
+    _cacheFramebuffer.bind();
+    _cacheFramebuffer.attachTextureLayer(_depthLayers, GL_DEPTH_ATTACHMENT, count);
+    prepareDepthTarget(_cacheFramebuffer);
+    _layerFramebuffer.bind();
+    _layerFramebuffer.attachTextureLayer(_depthLayers, GL_DEPTH_ATTACHMENT, 0);
+    prepareDepthTarget(_layerFramebuffer);
+    _layerFramebuffer.unbind();
+}
+
+void CascadedShadowMap::update(
+    const PerspectiveCamera& camera, const glm::vec3& lightDirection,
+    const std::vector<BoundingBox>& dynamicCasters, const DrawCasters& drawStatic,
+    const DrawCasters& drawDynamic) {
+    // the light looks along its direction from the origin, only its rotation matters
+    const glm::vec3 direction = glm::normalize(lightDirection);
+    const glm::vec3 up =
+        std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    const glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), direction, up);
+    if (lightView != _lightView) {
+        _lightView = lightView;
+        invalidate();
+    }
+
+    // splits halfway between uniform and logarithmic
+    const int count = static_cast<int>(_cascades.size());
+    const float znear = camera.znear;
+    const float zfar = std::min(_shadowDistance, camera.zfar);
+    float nearDepth = znear;
+    for (int i = 0; i < count; ++i) {
+        const float t = static_cast<float>(i + 1) / count;
+        const float uniform = znear + (zfar - znear) * t;
+        const float logarithmic = znear * std::pow(zfar / znear, t);
+        const float farDepth = 0.5f * (uniform + logarithmic);
+        fit(i, camera, nearDepth, farDepth);
+        nearDepth = farDepth;
+    }
+
+    auto& cache = GLStateCache::instance();
+    GLint viewport[4] = {};
+    bool rendered = false;
+    for (int i = 0; i < count; ++i) {
+        Cascade& cascade = _cascades[i];
+        ++cascade.statistics.frames;
+
+        bool dynamic = false;
+        for (const auto& box : dynamicCasters) {
+            dynamic = dynamic || overlaps(i, box);
+        }
+        if (cascade.cached && !dynamic && !cascade.hadDynamic) {
+            continue;
+        }
+
+        if (!rendered) {
+            glGetIntegerv(GL_VIEWPORT, viewport);
+            glViewport(0, 0, _resolution, _resolution);
+            cache.setEnabled(GL_DEPTH_TEST, true);
+            cache.depthMask(true);
+            cache.polygonMode(GL_FILL);
+            cache.setEnabled(GL_POLYGON_OFFSET_FILL, true);
+            cache.polygonOffset(2.0f, 4.0f);
+            rendered = true;
+        }
+
+        if (!cascade.cached) {
+            _cacheFramebuffer.bind();
+            _cacheFramebuffer.attachTextureLayer(_depthLayers, GL_DEPTH_ATTACHMENT, count + i);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            drawStatic(i, cascade.matrix);
+            cascade.cached = true;
+            ++cascade.statistics.staticRenders;
+        }
+
+        _layerFramebuffer.bind();
+        _layerFramebuffer.attachTextureLayer(_depthLayers, GL_DEPTH_ATTACHMENT, i);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, _cacheFramebuffer.getHandle());
+        glBlitFramebuffer(
+            0, 0, _resolution, _resolution, 0, 0, _resolution, _resolution,
+            GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        if (dynamic) {
+            drawDynamic(i, cascade.matrix);
+        }
+        cascade.hadDynamic = dynamic;
+        ++cascade.statistics.layerUpdates;
+    }
+
+    if (rendered) {
+        cache.setEnabled(GL_POLYGON_OFFSET_FILL, false);
+        _layerFramebuffer.unbind();
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+}
+
+void CascadedShadowMap::invalidate(const BoundingBox& box) {
+    for (int i = 0; i < static_cast<int>(_cascades.size()); ++i) {
+        if (_cascades[i].cached && overlaps(i, box)) {
+            _cascades[i].cached = false;
+        }
+    }
+}
+
+void CascadedShadowMap::invalidate() {
+    for (auto& cascade : _cascades) {
+        cascade.cached = false;
+    }
+}
+
+bool CascadedShadowMap::overlaps(int cascade, const BoundingBox& box) const {
+    const BoundingBox light = box.transform(_lightView);
+    const Cascade& bounds = _cascades[cascade];
+
+    return light.min.x <= bounds.boundsMax.x && light.max.x >= bounds.boundsMin.x &&
+           light.min.y <= bounds.boundsMax.y && light.max.y >= bounds.boundsMin.y &&
+           light.min.z <= bounds.boundsMax.z && light.max.z >= bounds.boundsMin.z;
+}
+
+void CascadedShadowMap::bind(int slot) const {
+    _depthLayers.bind(slot);
+}
+
+int CascadedShadowMap::getCascadeCount() const {
+    return static_cast<int>(_cascades.size());
+}
+
+const glm::mat4& CascadedShadowMap::getMatrix(int cascade) const {
+    return _cascades[cascade].matrix;
+}
+
+float CascadedShadowMap::getSplit(int cascade) const {
+    return _cascades[cascade].split;
+}
+
+float CascadedShadowMap::getTexelSize(int cascade) const {
+    return _cascades[cascade].texelSize;
+}
+
+const CascadedShadowMap::Statistics& CascadedShadowMap::getStatistics(int cascade) const {
+    return _cascades[cascade].statistics;
+}
+
+void CascadedShadowMap::fit(
+    int index, const PerspectiveCamera& camera, float nearDepth, float farDepth) {
+    // bounding sphere of the slice of the view frustum, its radius only changes with the
+    // field of view, so the cascade keeps its size while the camera moves
+    const float tanY = std::tan(camera.fovy * 0.5f);
+    const float tanX = tanY * camera.aspect;
+    const float middle = 0.5f * (nearDepth + farDepth);
+    float radius = 0.0f;
+    for (float depth : {nearDepth, farDepth}) {
+        const glm::vec3 corner(depth * tanX, depth * tanY, depth - middle);
+        radius = std::max(radius, glm::length(corner));
+    }
+    radius = std::ceil(radius * 16.0f) / 16.0f;
+
+    // the cascade reaches a quarter of the radius further than the sphere and moves in
+    // steps of that quarter, whole texels each, so the static casters stay valid until
+    // the camera travelled a step
+    const float extent = radius * 1.25f;
+    const float texelSize = 2.0f * extent / _resolution;
+    const float step = texelSize * std::max(1.0f, std::floor(0.25f * radius / texelSize));
+
+    const glm::vec3 center =
+        camera.transform.position + camera.transform.getFront() * middle;
+    const glm::vec3 lightCenter = glm::vec3(_lightView * glm::vec4(center, 1.0f));
+    const glm::vec3 snapped = glm::floor(lightCenter / step + 0.5f) * step;
+
+    Cascade& cascade = _cascades[index];
+    cascade.boundsMin = snapped - glm::vec3(extent);
+    cascade.boundsMax = snapped + glm::vec3(extent, extent, extent + casterDistance);
+    cascade.split = farDepth;
+    cascade.texelSize = texelSize;
+
+    // the light view looks down -z, casters closer to the light have a larger z
+    const glm::mat4 projection = glm::ortho(
+        cascade.boundsMin.x, cascade.boundsMax.x, cascade.boundsMin.y, cascade.boundsMax.y,
+        -cascade.boundsMax.z, -cascade.boundsMin.z);
+    const glm::mat4 matrix = projection * _lightView;
+    if (matrix != cascade.matrix) {
+        cascade.matrix = matrix;
+        cascade.cached = false;
+    }
+}
+
+void CascadedShadowMap::prepareDepthTarget(Framebuffer& framebuffer) {
+    // depth only, gl 3.3 requires the color buffers to be turned off for completeness
+    framebuffer.drawBuffer(GL_NONE);
+    framebuffer.readBuffer(GL_NONE);
+    const GLenum status = framebuffer.checkStatus();
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        throw std::runtime_error(framebuffer.getDiagnostic(status));
+    }
+}
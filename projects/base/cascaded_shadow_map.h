@@ -0,0 +1,99 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bounding_box.h"
+#include "camera.h"
+#include "framebuffer.h"
+#include "texture2d.h"
+
+// cascaded shadow map of a directional light. cascade i covers the view depths between
+// the splits i - 1 and i and is sampled from layer i of a depth texture array. the static
+// casters of every cascade are cached in a second set of layers and only rendered again
+// when the cascade moves, which it does in coarse snapped steps, or when invalidate()
+// reports a change inside it. an update copies the cached layer over the sampled one and
+// adds the dynamic casters, a cascade without dynamic casters in this and the last frame
+// is not touched at all
+class CascadedShadowMap {
+public:
+    static constexpr int maxCascades = 4;
+
+    // counted since construction
+    struct Statistics {
+        size_t frames = 0;
+        size_t staticRenders = 0; // the cached static casters were rendered again
+        size_t layerUpdates = 0; // the sampled layer was rewritten
+    };
+
+    // draws the casters into the bound depth target with the matrix of the cascade
+    using DrawCasters = std::function<void(int cascade, const glm::mat4& lightViewProjection)>;
+
+    CascadedShadowMap(int resolution, int cascadeCount, float shadowDistance);
+
+    CascadedShadowMap(const CascadedShadowMap&) = delete;
+
+    CascadedShadowMap& operator=(const CascadedShadowMap&) = delete;
+
+    // fits the cascades to the camera and renders what changed. leaves the default
+    // framebuffer bound and the viewport as it found it
+    void update(
+        const PerspectiveCamera& camera, const glm::vec3& lightDirection,
+        const std::vector<BoundingBox>& dynamicCasters, const DrawCasters& drawStatic,
+        const DrawCasters& drawDynamic);
+
+    // static casters changed inside the world box
+    void invalidate(const BoundingBox& box);
+
+    void invalidate();
+
+    // whether a caster inside the world box can cast into the cascade
+    bool overlaps(int cascade, const BoundingBox& box) const;
+
+    // the sampled layers, with depth comparison for a sampler2DArrayShadow
+    void bind(int slot) const;
+
+    int getCascadeCount() const;
+
+    // world to light clip space
+    const glm::mat4& getMatrix(int cascade) const;
+
+    // far view depth of the cascade
+    float getSplit(int cascade) const;
+
+    // world size of a texel, for normal offsets against shadow acne
+    float getTexelSize(int cascade) const;
+
+    const Statistics& getStatistics(int cascade) const;
+
+private:
+    struct Cascade {
+        glm::mat4 matrix = glm::mat4(0.0f);
+        glm::vec3 boundsMin; // light view space box the cascade covers
+        glm::vec3 boundsMax;
+        float split = 0.0f;
+        float texelSize = 0.0f;
+        bool cached = false; // the static layer holds the casters for the matrix
+        bool hadDynamic = false;
+        Statistics statistics;
+    };
+
+    // how far beyond a cascade towards the light casters are still rendered
+    static constexpr float casterDistance = 20.0f;
+
+    int _resolution;
+    float _shadowDistance;
+    std::vector<Cascade> _cascades;
+    glm::mat4 _lightView = glm::mat4(0.0f);
+
+    // layers [0, n) are sampled, [n, 2n) cache the static casters
+    Texture2DArray _depthLayers;
+    Framebuffer _cacheFramebuffer;
+    Framebuffer _layerFramebuffer;
+
+    void fit(int index, const PerspectiveCamera& camera, float nearDepth, float farDepth);
+
+    static void prepareDepthTarget(Framebuffer& framebuffer);
+};
@@ -0,0 +1,378 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "chunked_terrain.h"
+#include "gl_state_cache.h"
+
+constexpr int ChunkedTerrain::maxUploadsPerFrame;
+
+namespace {
+constexpr int stitchCount = 16;
+
+// edge bits of Chunk::stitches and the neighbour across each edge
+constexpr uint8_t stitchNegativeX = 1 << 0;
+constexpr uint8_t stitchPositiveX = 1 << 1;
+constexpr uint8_t stitchNegativeZ = 1 << 2;
+constexpr uint8_t stitchPositiveZ = 1 << 3;
+const int neighbourRows[4] = {0, 0, -1, 1};
+const int neighbourColumns[4] = {-1, 1, 0, 0};
+} // namespace
+
+ChunkedTerrain::ChunkedTerrain(
+    float chunkSize, int quads, int levelCount, int columns, HeightFunction height,
+    ThreadPool* threadPool)
+    : _chunkSize(chunkSize), _quads(quads), _levelCount(levelCount), _columns(columns),
+      _height(std::move(height)), _threadPool(threadPool) {
+    if (levelCount < 1 || quads % (1 << (levelCount - 1)) != 0 || (quads & (quads - 1)) != 0) {
+        throw std::runtime_error("terrain chunk quads must be a power of two fitting every level");
+    }
+
+    buildIndices();
+}
+
+ChunkedTerrain::~ChunkedTerrain() {
+    for (auto& entry : _chunks) {
+        release(entry.second);
+    }
+
+    for (auto& pending : _abandoned) {
+        pending.wait();
+    }
+
+    for (const Slot& slot : _freeSlots) {
+        GLStateCache::instance().forgetVertexArray(slot.vao);
+        glDeleteVertexArrays(1, &slot.vao);
+        GLStateCache::instance().forgetBuffer(slot.vbo);
+        glDeleteBuffers(1, &slot.vbo);
+    }
+
+    GLStateCache::instance().forgetBuffer(_indexBuffer);
+    glDeleteBuffers(1, &_indexBuffer);
+}
+
+void ChunkedTerrain::update(const glm::vec3& eye, float ahead, float behind) {
+    _changedBoxes.clear();
+
+    const int firstRow = static_cast<int>(std::floor((eye.z - ahead) / _chunkSize));
+    const int lastRow = static_cast<int>(std::floor((eye.z + behind) / _chunkSize));
+
+    for (auto it = _chunks.begin(); it != _chunks.end();) {
+        if (it->second.row < firstRow || it->second.row > lastRow) {
+            release(it->second);
+            it = _chunks.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // rows nearest to the eye first, the pool runs its tasks in order
+    const int eyeRow = static_cast<int>(std::floor(eye.z / _chunkSize));
+    for (int distance = 0; eyeRow - distance >= firstRow || eyeRow + distance <= lastRow;
+         ++distance) {
+        if (eyeRow - distance >= firstRow && eyeRow - distance <= lastRow) {
+            request(eyeRow - distance);
+        }
+        if (distance > 0 && eyeRow + distance >= firstRow && eyeRow + distance <= lastRow) {
+            request(eyeRow + distance);
+        }
+    }
+
+    int uploads = 0;
+    for (auto& entry : _chunks) {
+        Chunk& chunk = entry.second;
+        if (uploads < maxUploadsPerFrame && !chunk.ready
+            && chunk.pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            upload(chunk);
+            ++uploads;
+        }
+    }
+
+    _abandoned.erase(
+        std::remove_if(
+            _abandoned.begin(), _abandoned.end(),
+            [](const std::future<ChunkData>& pending) {
+                return pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+            }),
+        _abandoned.end());
+
+    selectLevels(eye);
+}
+
+void ChunkedTerrain::request(int row) {
+    for (int column = 0; column < _columns; ++column) {
+        const int64_t key = makeKey(row, column);
+        if (_chunks.count(key) != 0) {
+            continue;
+        }
+
+        Chunk& chunk = _chunks[key];
+        chunk.row = row;
+        chunk.column = column;
+        if (_threadPool != nullptr) {
+            chunk.pending =
+                _threadPool->submit([this, row, column]() { return generate(row, column); });
+        } else {
+            std::promise<ChunkData> generated;
+            generated.set_value(generate(row, column));
+            chunk.pending = generated.get_future();
+        }
+    }
+}
+
+void ChunkedTerrain::finishPending() {
+    for (auto& entry : _chunks) {
+        if (!entry.second.ready) {
+            upload(entry.second);
+        }
+    }
+}
+
+void ChunkedTerrain::getDraws(std::vector<ChunkDraw>& draws, int fixedLevel) const {
+    for (const auto& entry : _chunks) {
+        const Chunk& chunk = entry.second;
+        if (!chunk.ready) {
+            continue;
+        }
+
+        const int level = fixedLevel < 0 ? chunk.level : std::min(fixedLevel, _levelCount - 1);
+        const IndexRange& range =
+            _ranges[level * stitchCount + (fixedLevel < 0 ? chunk.stitches : 0)];
+
+        ChunkDraw draw;
+        draw.draw.vao = chunk.slot.vao;
+        draw.draw.indexCount = range.count;
+        draw.draw.firstIndex = range.first;
+        draw.model = chunk.model;
+        draw.box = chunk.box;
+        draws.push_back(draw);
+    }
+}
+
+const std::vector<BoundingBox>& ChunkedTerrain::getChangedBoxes() const {
+    return _changedBoxes;
+}
+
+int ChunkedTerrain::getLevelCount() const {
+    return _levelCount;
+}
+
+const ChunkedTerrain::Statistics& ChunkedTerrain::getStatistics() const {
+    return _statistics;
+}
+
+int64_t ChunkedTerrain::makeKey(int row, int column) {
+    return (static_cast<int64_t>(row) << 32) | static_cast<uint32_t>(column);
+}
+
+glm::vec3 ChunkedTerrain::getOrigin(int row, int column) const {
+    return glm::vec3((column - 0.5f * _columns) * _chunkSize, 0.0f, row * _chunkSize);
+}
+
+void ChunkedTerrain::buildIndices() {
+    const int side = _quads + 1;
+    std::vector<uint32_t> indices;
+    _ranges.resize(_levelCount * stitchCount);
+    for (int level = 0; level < _levelCount; ++level) {
+        const int step = 1 << level;
+        // the coarsest level has no coarser neighbour to stitch to
+        const int variants = level + 1 < _levelCount ? stitchCount : 1;
+        for (int stitches = 0; stitches < variants; ++stitches) {
+            // odd vertices of a stitched edge move onto the even vertex before them,
+            // which leaves the edge exactly as the next coarser level draws it
+            auto index = [&](int i, int j) {
+                if (((stitches & stitchNegativeX) && i == 0)
+                    || ((stitches & stitchPositiveX) && i == _quads)) {
+                    j -= (j / step) % 2 * step;
+                }
+                if (((stitches & stitchNegativeZ) && j == 0)
+                    || ((stitches & stitchPositiveZ) && j == _quads)) {
+                    i -= (i / step) % 2 * step;
+                }
+                return static_cast<uint32_t>(j * side + i);
+            };
+
+            auto addTriangle = [&indices](uint32_t a, uint32_t b, uint32_t c) {
+                // snapped triangles may collapse
+                if (a != b && b != c && c != a) {
+                    indices.insert(indices.end(), {a, b, c});
+                }
+            };
+
+            IndexRange& range = _ranges[level * stitchCount + stitches];
+            range.first = static_cast<GLsizei>(indices.size());
+            for (int j = 0; j < _quads; j += step) {
+                for (int i = 0; i < _quads; i += step) {
+                    const uint32_t a = index(i, j);
+                    const uint32_t b = index(i, j + step);
+                    const uint32_t c = index(i + step, j);
+                    const uint32_t d = index(i + step, j + step);
+                    addTriangle(a, b, c);
+                    addTriangle(c, b, d);
+                }
+            }
+            range.count = static_cast<GLsizei>(indices.size()) - range.first;
+        }
+
+        for (int stitches = variants; stitches < stitchCount; ++stitches) {
+            _ranges[level * stitchCount + stitches] = _ranges[level * stitchCount];
+        }
+    }
+
+    // bound as element array by the vao of every chunk
+    glGenBuffers(1, &_indexBuffer);
+    GLStateCache::instance().bindBuffer(GL_ARRAY_BUFFER, _indexBuffer);
+    glBufferData(
+        GL_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+}
+
+ChunkedTerrain::ChunkData ChunkedTerrain::generate(int row, int column) const {
+    const glm::vec3 origin = getOrigin(row, column);
+    const float spacing = _chunkSize / _quads;
+
+    // heights with a ring of one vertex around the chunk, so normals at the edges match
+    // the ones of the neighbours
+    const int side = _quads + 3;
+    std::vector<float> heights(side * side);
+    for (int j = 0; j < side; ++j) {
+        for (int i = 0; i < side; ++i) {
+            heights[j * side + i] =
+                _height(origin.x + (i - 1) * spacing, origin.z + (j - 1) * spacing);
+        }
+    }
+
+    auto height = [&heights, side](int i, int j) { return heights[(j + 1) * side + i + 1]; };
+
+    ChunkData data;
+    data.vertices.reserve((_quads + 1) * (_quads + 1));
+    for (int j = 0; j <= _quads; ++j) {
+        for (int i = 0; i <= _quads; ++i) {
+            const glm::vec3 position(i * spacing, height(i, j), j * spacing);
+            const glm::vec3 normal = glm::normalize(glm::vec3(
+                height(i - 1, j) - height(i + 1, j), 2.0f * spacing,
+                height(i, j - 1) - height(i, j + 1)));
+            data.vertices.emplace_back(position, normal, glm::vec2(i, j) / float(_quads));
+            data.box.min = glm::min(data.box.min, position);
+            data.box.max = glm::max(data.box.max, position);
+        }
+    }
+
+    return data;
+}
+
+void ChunkedTerrain::upload(Chunk& chunk) {
+    const ChunkData data = chunk.pending.get();
+
+    if (_freeSlots.empty()) {
+        Slot slot;
+        glGenVertexArrays(1, &slot.vao);
+        glGenBuffers(1, &slot.vbo);
+
+        GLStateCache::instance().bindVertexArray(slot.vao);
+        GLStateCache::instance().bindBuffer(GL_ARRAY_BUFFER, slot.vbo);
+        glBufferData(
+            GL_ARRAY_BUFFER, sizeof(Vertex) * data.vertices.size(), nullptr, GL_STATIC_DRAW);
+        GLStateCache::instance().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indexBuffer);
+
+        glVertexAttribPointer(
+            0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(
+            1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(
+            2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));
+        glEnableVertexAttribArray(2);
+
+        GLStateCache::instance().bindVertexArray(0);
+        _freeSlots.push_back(slot);
+    }
+
+    chunk.slot = _freeSlots.back();
+    _freeSlots.pop_back();
+    GLStateCache::instance().bindBuffer(GL_ARRAY_BUFFER, chunk.slot.vbo);
+    glBufferSubData(
+        GL_ARRAY_BUFFER, 0, sizeof(Vertex) * data.vertices.size(), data.vertices.data());
+
+    chunk.model = glm::translate(glm::mat4(1.0f), getOrigin(chunk.row, chunk.column));
+    chunk.box = data.box.transform(chunk.model);
+    chunk.ready = true;
+    _changedBoxes.push_back(chunk.box);
+}
+
+void ChunkedTerrain::release(Chunk& chunk) {
+    if (chunk.ready) {
+        _freeSlots.push_back(chunk.slot);
+        _changedBoxes.push_back(chunk.box);
+    } else {
+        // the task cannot be stopped, it finishes and its result is dropped
+        _abandoned.push_back(std::move(chunk.pending));
+    }
+}
+
+void ChunkedTerrain::selectLevels(const glm::vec3& eye) {
+    for (auto& entry : _chunks) {
+        Chunk& chunk = entry.second;
+        if (!chunk.ready) {
+            continue;
+        }
+
+        const float distance =
+            glm::length(eye - glm::clamp(eye, chunk.box.min, chunk.box.max));
+        // one level coarser every time the distance doubles past one chunk
+        chunk.level = 0;
+        while (chunk.level + 1 < _levelCount && distance > _chunkSize * (1 << chunk.level)) {
+            ++chunk.level;
+        }
+    }
+
+    // stitching bridges one level, finer neighbours pull a chunk down until none is
+    // more than one level apart
+    for (bool lowered = true; lowered;) {
+        lowered = false;
+        for (auto& entry : _chunks) {
+            Chunk& chunk = entry.second;
+            if (!chunk.ready) {
+                continue;
+            }
+
+            for (int edge = 0; edge < 4; ++edge) {
+                const Chunk* neighbour = findReady(
+                    chunk.row + neighbourRows[edge], chunk.column + neighbourColumns[edge]);
+                if (neighbour != nullptr && chunk.level > neighbour->level + 1) {
+                    chunk.level = neighbour->level + 1;
+                    lowered = true;
+                }
+            }
+        }
+    }
+
+    _statistics = Statistics();
+    for (auto& entry : _chunks) {
+        Chunk& chunk = entry.second;
+        if (!chunk.ready) {
+            ++_statistics.pendingChunks;
+            continue;
+        }
+
+        chunk.stitches = 0;
+        for (int edge = 0; edge < 4; ++edge) {
+            const Chunk* neighbour = findReady(
+                chunk.row + neighbourRows[edge], chunk.column + neighbourColumns[edge]);
+            if (neighbour != nullptr && neighbour->level > chunk.level) {
+                chunk.stitches |= 1 << edge;
+            }
+        }
+
+        ++_statistics.residentChunks;
+        _statistics.triangles += _ranges[chunk.level * stitchCount + chunk.stitches].count / 3;
+    }
+}
+
+const ChunkedTerrain::Chunk* ChunkedTerrain::findReady(int row, int column) const {
+    auto it = _chunks.find(makeKey(row, column));
+    return it != _chunks.end() && it->second.ready ? &it->second : nullptr;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bounding_box.h"
+#include "gl_utility.h"
+#include "render_queue.h"
+#include "thread_pool.h"
+#include "vertex.h"
+
+// heightfield terrain streamed in square chunks along -z, columns chunks wide and centred
+// on x = 0. chunks are generated on the pool ahead of the camera, uploaded a few per frame
+// and released behind it, so memory stays bounded by the rows in reach however far the
+// camera travels.
+//
+// geomipmapping: level l of a chunk uses every 2^l-th vertex of its grid. one index buffer
+// shared by all chunks holds every level with every combination of stitched edges, an edge
+// next to a coarser chunk snaps its odd vertices onto the even ones so both sides meet
+// without cracks. levels are chosen by distance and neighbours kept within one level.
+class ChunkedTerrain {
+public:
+    // must be safe to call from several threads at once
+    using HeightFunction = std::function<float(float x, float z)>;
+
+    struct ChunkDraw {
+        RenderQueue::DrawCall draw;
+        glm::mat4 model;
+        BoundingBox box; // in world space
+    };
+
+    struct Statistics {
+        size_t residentChunks = 0;
+        size_t pendingChunks = 0;
+        size_t triangles = 0; // of the levels selected by the last update
+    };
+
+    // chunks of chunkSize x chunkSize world units with quads x quads cells, quads a power
+    // of two with at least 2^(levelCount - 1) cells per side
+    ChunkedTerrain(
+        float chunkSize, int quads, int levelCount, int columns, HeightFunction height,
+        ThreadPool* threadPool);
+
+    ChunkedTerrain(const ChunkedTerrain&) = delete;
+
+    ChunkedTerrain& operator=(const ChunkedTerrain&) = delete;
+
+    // waits for the chunks still generating
+    ~ChunkedTerrain();
+
+    // streams the rows from ahead in front of the eye to behind past it, uploads at most
+    // maxUploadsPerFrame finished chunks and selects the level of every resident chunk
+    void update(const glm::vec3& eye, float ahead, float behind);
+
+    // waits for every chunk requested so far and uploads them, e.g. before the first frame
+    void finishPending();
+
+    // the resident chunks at their selected level, or all at fixedLevel without stitching
+    void getDraws(std::vector<ChunkDraw>& draws, int fixedLevel = -1) const;
+
+    // world boxes of the chunks uploaded or released by the last update
+    const std::vector<BoundingBox>& getChangedBoxes() const;
+
+    int getLevelCount() const;
+
+    const Statistics& getStatistics() const;
+
+    static constexpr int maxUploadsPerFrame = 4;
+
+private:
+    struct ChunkData {
+        std::vector<Vertex> vertices;
+        BoundingBox box; // in chunk space
+    };
+
+    // a vao and a vertex buffer sized for one chunk, recycled between chunks
+    struct Slot {
+        GLuint vao = 0;
+        GLuint vbo = 0;
+    };
+
+    struct Chunk {
+        int row = 0;
+        int column = 0;
+        std::future<ChunkData> pending; // valid until uploaded
+        Slot slot;
+        bool ready = false;
+        glm::mat4 model;
+        BoundingBox box; // in world space
+        int level = 0;
+        uint8_t stitches = 0; // edges next to a coarser chunk, -x, +x, -z, +z
+    };
+
+    struct IndexRange {
+        GLsizei first = 0;
+        GLsizei count = 0;
+    };
+
+    float _chunkSize;
+    int _quads;
+    int _levelCount;
+    int _columns;
+    HeightFunction _height;
+    ThreadPool* _threadPool;
+
+    GLuint _indexBuffer = 0;
+    std::vector<IndexRange> _ranges; // level * 16 + stitches
+
+    std::unordered_map<int64_t, Chunk> _chunks;
+    std::vector<Slot> _freeSlots;
+    std::vector<std::future<ChunkData>> _abandoned; // released while generating
+
+    std::vector<BoundingBox> _changedBoxes;
+
+    Statistics _statistics;
+
+    static int64_t makeKey(int row, int column);
+
+    glm::vec3 getOrigin(int row, int column) const;
+
+    void buildIndices();
+
+    // starts generating the chunks of the row that are not resident or pending yet
+    void request(int row);
+
+    ChunkData generate(int row, int column) const;
+
+    void upload(Chunk& chunk);
+
+    void release(Chunk& chunk);
+
+    void selectLevels(const glm::vec3& eye);
+
+    const Chunk* findReady(int row, int column) const;
+};
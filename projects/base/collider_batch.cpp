@@ -0,0 +1,202 @@
+#include <algorithm>
+
+#include "collider_batch.h"
+#include "simd.h"
+
+void ColliderBatch::pushBox(const BoundingBox& box) {
+    push(box, glm::vec3(0.0f), 0.0f, false);
+}
+
+void ColliderBatch::pushSphere(const glm::vec3& center, float radius) {
+    BoundingBox box;
+    box.min = center - glm::vec3(radius);
+    box.max = center + glm::vec3(radius);
+    push(box, center, radius, true);
+}
+
+void ColliderBatch::popFront(size_t count) {
+    _head += std::min(count, size());
+    if (_head == _minX.size()) {
+        clear();
+    } else {
+        compact();
+    }
+}
+
+size_t ColliderBatch::size() const {
+    return _minX.size() - _head;
+}
+
+bool ColliderBatch::empty() const {
+    return size() == 0;
+}
+
+void ColliderBatch::clear() {
+    _head = 0;
+    _minX.clear();
+    _minY.clear();
+    _minZ.clear();
+    _maxX.clear();
+    _maxY.clear();
+    _maxZ.clear();
+    _centerX.clear();
+    _centerY.clear();
+    _centerZ.clear();
+    _radius.clear();
+    _sphere.clear();
+}
+
+bool ColliderBatch::intersects(const BoundingBox& box) const {
+    return intersects(box, 0, size());
+}
+
+bool ColliderBatch::intersects(const BoundingBox& box, size_t first, size_t last) const {
+    last = std::min(last, size());
+    if (first >= last) {
+        return false;
+    }
+
+    size_t i = _head + first;
+    const size_t end = _head + last;
+
+#if defined(CG_SIMD_AVX)
+    {
+        const __m256 qMinX = _mm256_set1_ps(box.min.x), qMaxX = _mm256_set1_ps(box.max.x);
+        const __m256 qMinY = _mm256_set1_ps(box.min.y), qMaxY = _mm256_set1_ps(box.max.y);
+        const __m256 qMinZ = _mm256_set1_ps(box.min.z), qMaxZ = _mm256_set1_ps(box.max.z);
+        for (; i + 8 <= end; i += 8) {
+            // box against box
+            __m256 overlap = _mm256_and_ps(
+                _mm256_cmp_ps(qMinX, _mm256_loadu_ps(&_maxX[i]), _CMP_LE_OQ),
+                _mm256_cmp_ps(qMaxX, _mm256_loadu_ps(&_minX[i]), _CMP_GE_OQ));
+            overlap = _mm256_and_ps(
+                overlap, _mm256_cmp_ps(qMinY, _mm256_loadu_ps(&_maxY[i]), _CMP_LE_OQ));
+            overlap = _mm256_and_ps(
+                overlap, _mm256_cmp_ps(qMaxY, _mm256_loadu_ps(&_minY[i]), _CMP_GE_OQ));
+            overlap = _mm256_and_ps(
+                overlap, _mm256_cmp_ps(qMinZ, _mm256_loadu_ps(&_maxZ[i]), _CMP_LE_OQ));
+            overlap = _mm256_and_ps(
+                overlap, _mm256_cmp_ps(qMaxZ, _mm256_loadu_ps(&_minZ[i]), _CMP_GE_OQ));
+
+            // sphere against box, the same operation order as the scalar glm::length
+            const __m256 cx = _mm256_loadu_ps(&_centerX[i]);
+            const __m256 cy = _mm256_loadu_ps(&_centerY[i]);
+            const __m256 cz = _mm256_loadu_ps(&_centerZ[i]);
+            const __m256 dx = _mm256_sub_ps(_mm256_min_ps(_mm256_max_ps(cx, qMinX), qMaxX), cx);
+            const __m256 dy = _mm256_sub_ps(_mm256_min_ps(_mm256_max_ps(cy, qMinY), qMaxY), cy);
+            const __m256 dz = _mm256_sub_ps(_mm256_min_ps(_mm256_max_ps(cz, qMinZ), qMaxZ), cz);
+            const __m256 dist = _mm256_sqrt_ps(_mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+                _mm256_mul_ps(dz, dz)));
+            const __m256 inside =
+                _mm256_cmp_ps(dist, _mm256_loadu_ps(&_radius[i]), _CMP_LT_OQ);
+
+            const __m256 sphere =
+                _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)&_sphere[i]));
+            const __m256 hit =
+                _mm256_or_ps(_mm256_and_ps(sphere, inside), _mm256_andnot_ps(sphere, overlap));
+            if (_mm256_movemask_ps(hit) != 0) {
+                return true;
+            }
+        }
+    }
+#endif
+
+#if defined(CG_SIMD_SSE2)
+    {
+        const __m128 qMinX = _mm_set1_ps(box.min.x), qMaxX = _mm_set1_ps(box.max.x);
+        const __m128 qMinY = _mm_set1_ps(box.min.y), qMaxY = _mm_set1_ps(box.max.y);
+        const __m128 qMinZ = _mm_set1_ps(box.min.z), qMaxZ = _mm_set1_ps(box.max.z);
+        for (; i + 4 <= end; i += 4) {
+            // box against box
+            __m128 overlap = _mm_and_ps(
+                _mm_cmple_ps(qMinX, _mm_loadu_ps(&_maxX[i])),
+                _mm_cmpge_ps(qMaxX, _mm_loadu_ps(&_minX[i])));
+            overlap = _mm_and_ps(overlap, _mm_cmple_ps(qMinY, _mm_loadu_ps(&_maxY[i])));
+            overlap = _mm_and_ps(overlap, _mm_cmpge_ps(qMaxY, _mm_loadu_ps(&_minY[i])));
+            overlap = _mm_and_ps(overlap, _mm_cmple_ps(qMinZ, _mm_loadu_ps(&_maxZ[i])));
+            overlap = _mm_and_ps(overlap, _mm_cmpge_ps(qMaxZ, _mm_loadu_ps(&_minZ[i])));
+
+            // sphere against box, the same operation order as the scalar glm::length
+            const __m128 cx = _mm_loadu_ps(&_centerX[i]);
+            const __m128 cy = _mm_loadu_ps(&_centerY[i]);
+            const __m128 cz = _mm_loadu_ps(&_centerZ[i]);
+            const __m128 dx = _mm_sub_ps(_mm_min_ps(_mm_max_ps(cx, qMinX), qMaxX), cx);
+            const __m128 dy = _mm_sub_ps(_mm_min_ps(_mm_max_ps(cy, qMinY), qMaxY), cy);
+            const __m128 dz = _mm_sub_ps(_mm_min_ps(_mm_max_ps(cz, qMinZ), qMaxZ), cz);
+            const __m128 dist = _mm_sqrt_ps(_mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+            const __m128 inside = _mm_cmplt_ps(dist, _mm_loadu_ps(&_radius[i]));
+
+            const __m128 sphere =
+                _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)&_sphere[i]));
+            const __m128 hit =
+                _mm_or_ps(_mm_and_ps(sphere, inside), _mm_andnot_ps(sphere, overlap));
+            if (_mm_movemask_ps(hit) != 0) {
+                return true;
+            }
+        }
+    }
+#endif
+
+    return intersectsScalar(box, i - _head, last);
+}
+
+bool ColliderBatch::intersectsScalar(const BoundingBox& box, size_t first, size_t last) const {
+    last = std::min(last, size());
+    for (size_t i = _head + first; i < _head + last; ++i) {
+        if (_sphere[i]) {
+            const glm::vec3 center(_centerX[i], _centerY[i], _centerZ[i]);
+            const glm::vec3 clamped = glm::clamp(center, box.min, box.max);
+            if (glm::length(clamped - center) < _radius[i]) {
+                return true;
+            }
+            continue;
+        }
+
+        const bool xOverlap = (box.min.x <= _maxX[i]) && (box.max.x >= _minX[i]);
+        const bool yOverlap = (box.min.y <= _maxY[i]) && (box.max.y >= _minY[i]);
+        const bool zOverlap = (box.min.z <= _maxZ[i]) && (box.max.z >= _minZ[i]);
+        if (xOverlap && yOverlap && zOverlap) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ColliderBatch::push(
+    const BoundingBox& box, const glm::vec3& center, float radius, bool sphere) {
+    _minX.push_back(box.min.x);
+    _minY.push_back(box.min.y);
+    _minZ.push_back(box.min.z);
+    _maxX.push_back(box.max.x);
+    _maxY.push_back(box.max.y);
+    _maxZ.push_back(box.max.z);
+    _centerX.push_back(center.x);
+    _centerY.push_back(center.y);
+    _centerZ.push_back(center.z);
+    _radius.push_back(radius);
+    _sphere.push_back(sphere ? ~0 : 0);
+}
+
+void ColliderBatch::compact() {
+    // move the live colliders down once at least half of the storage is released
+    if (_head < 64 || 2 * _head < _minX.size()) {
+        return;
+    }
+
+    auto drop = [this](auto& values) { values.erase(values.begin(), values.begin() + _head); };
+    drop(_minX);
+    drop(_minY);
+    drop(_minZ);
+    drop(_maxX);
+    drop(_maxY);
+    drop(_maxZ);
+    drop(_centerX);
+    drop(_centerY);
+    drop(_centerZ);
+    drop(_radius);
+    drop(_sphere);
+    _head = 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bounding_box.h"
+
+// world space boxes and spheres stored as structure of arrays, so one query box
+// is tested against 4 (sse) or 8 (avx) colliders per instruction. colliders are
+// appended at the back and released from the front like a queue, index 0 is the
+// oldest live collider
+class ColliderBatch {
+public:
+    void pushBox(const BoundingBox& box);
+
+    void pushSphere(const glm::vec3& center, float radius);
+
+    void popFront(size_t count = 1);
+
+    size_t size() const;
+
+    bool empty() const;
+
+    void clear();
+
+    // whether any collider in [first, last) touches box: boxes overlap when they overlap
+    // on all three axes (touching counts), a sphere when the point of box closest to the
+    // center is nearer than the radius
+    bool intersects(const BoundingBox& box, size_t first, size_t last) const;
+
+    bool intersects(const BoundingBox& box) const;
+
+    // reference implementation used for the tail of a batch and the non simd targets
+    bool intersectsScalar(const BoundingBox& box, size_t first, size_t last) const;
+
+private:
+    // offset of the logical front in the arrays, released storage is compacted lazily
+    size_t _head = 0;
+
+    std::vector<float> _minX, _minY, _minZ;
+    std::vector<float> _maxX, _maxY, _maxZ;
+    std::vector<float> _centerX, _centerY, _centerZ;
+    std::vector<float> _radius;
+    std::vector<int> _sphere; // all bits set for a sphere
+
+    void push(const BoundingBox& box, const glm::vec3& center, float radius, bool sphere);
+
+    void compact();
+};
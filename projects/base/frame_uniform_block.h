@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "camera.h"
+#include "cascaded_shadow_map.h"
+#include "light.h"
+#include "light_clusters.h"
+
+// camera and lights shared by every scene program, uploaded once per frame into a
+// uniform buffer bound at a fixed binding point. the layout mirrors the std140 block
+// returned by getDeclaration(), a vec3 followed by a float shares one 16 byte slot
+struct FrameUniformBlock {
+    static constexpr uint32_t binding = 0;
+
+    struct Ambient {
+        glm::vec3 color;
+        float intensity;
+    };
+
+    struct Directional {
+        glm::vec3 direction;
+        float intensity;
+        glm::vec3 color;
+        float padding;
+    };
+
+    struct Spot {
+        glm::vec3 position;
+        float padding0;
+        glm::vec3 direction;
+        float intensity;
+        glm::vec3 color;
+        float angle;
+        float kc;
+        float kl;
+        float kq;
+        float padding1;
+    };
+
+    struct Clusters {
+        glm::uvec4 size; // tiles in x and y, slices, lights
+        glm::vec4 scale; // tiles per pixel in x and y, slice scale and bias over log(depth)
+    };
+
+    struct Shadows {
+        glm::mat4 matrices[CascadedShadowMap::maxCascades]; // world to light clip space
+        glm::vec4 splits; // far view depth of every cascade, 0 past the last one
+        glm::vec4 texelSizes; // world size of a shadow map texel in every cascade
+    };
+
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 viewPos;
+    float padding;
+    Ambient ambientLight;
+    Directional directionalLight;
+    Spot spotLight;
+    Clusters clusters;
+    Shadows shadows;
+
+    void setCamera(const Camera& camera) {
+        projection = camera.getProjectionMatrix();
+        view = camera.getViewMatrix();
+        viewPos = camera.transform.position;
+    }
+
+    void setAmbientLight(const AmbientLight& light) {
+        ambientLight.color = light.color;
+        ambientLight.intensity = light.intensity;
+    }
+
+    void setDirectionalLight(const DirectionalLight& light) {
+        directionalLight.direction = light.transform.getFront();
+        directionalLight.intensity = light.intensity;
+        directionalLight.color = light.color;
+    }
+
+    void setSpotLight(const SpotLight& light) {
+        spotLight.position = light.transform.position;
+        spotLight.direction = light.transform.getFront();
+        spotLight.intensity = light.intensity;
+        spotLight.color = light.color;
+        spotLight.angle = light.angle;
+        spotLight.kc = light.kc;
+        spotLight.kl = light.kl;
+        spotLight.kq = light.kq;
+    }
+
+    // after the clusters were updated for the frame, the size is the viewport in pixels
+    void setLightClusters(const LightClusters& lightClusters, int width, int height) {
+        const glm::ivec3 grid = lightClusters.getGridSize();
+        clusters.size = glm::uvec4(
+            grid.x, grid.y, grid.z, static_cast<uint32_t>(lightClusters.getLightCount()));
+        clusters.scale = glm::vec4(
+            static_cast<float>(grid.x) / std::max(width, 1),
+            static_cast<float>(grid.y) / std::max(height, 1), lightClusters.getSliceScale(),
+            lightClusters.getSliceBias());
+    }
+
+    void setShadows(const CascadedShadowMap& shadowMap) {
+        shadows.splits = glm::vec4(0.0f);
+        shadows.texelSizes = glm::vec4(0.0f);
+        for (int i = 0; i < shadowMap.getCascadeCount(); ++i) {
+            shadows.matrices[i] = shadowMap.getMatrix(i);
+            shadows.splits[i] = shadowMap.getSplit(i);
+            shadows.texelSizes[i] = shadowMap.getTexelSize(i);
+        }
+    }
+
+    // glsl declaration of the block and its structs, to be placed after #version
+    static const char* getDeclaration() {
+        return "struct AmbientLight {\n"
+               "    vec3 color;\n"
+               "    float intensity;\n"
+               "};\n"
+               "struct DirectionalLight {\n"
+               "    vec3 direction;\n"
+               "    float intensity;\n"
+               "    vec3 color;\n"
+               "};\n"
+               "struct SpotLight {\n"
+               "    vec3 position;\n"
+               "    vec3 direction;\n"
+               "    float intensity;\n"
+               "    vec3 color;\n"
+               "    float angle;\n"
+               "    float kc;\n"
+               "    float kl;\n"
+               "    float kq;\n"
+               "};\n"
+               "struct LightClusters {\n"
+               "    uvec4 size;\n"
+               "    vec4 scale;\n"
+               "};\n"
+               "struct Shadows {\n"
+               "    mat4 matrices[4];\n"
+               "    vec4 splits;\n"
+               "    vec4 texelSizes;\n"
+               "};\n"
+               "layout(std140) uniform FrameData {\n"
+               "    mat4 projection;\n"
+               "    mat4 view;\n"
+               "    vec3 viewPos;\n"
+               "    AmbientLight ambientLight;\n"
+               "    DirectionalLight directionalLight;\n"
+               "    SpotLight spotLight;\n"
+               "    LightClusters clusters;\n"
+               "    Shadows shadows;\n"
+               "};\n";
+    }
+
+    static const char* getName() {
+        return "FrameData";
+    }
+};
+
+// std140 offsets of the glsl block above
+static_assert(offsetof(FrameUniformBlock, projection) == 0, "std140 layout mismatch");
+static_assert(offsetof(FrameUniformBlock, view) == 64, "std140 layout mismatch");
+static_assert(offsetof(FrameUniformBlock, viewPos) == 128, "std140 layout mismatch");
+static_assert(offsetof(FrameUniformBlock, ambientLight) == 144, "std140 layout mismatch");
+static_assert(offsetof(FrameUniformBlock, directionalLight) == 160, "std140 layout mismatch");
+static_assert(offsetof(FrameUniformBlock, spotLight) == 192, "std140 layout mismatch");
+static_assert(offsetof(FrameUniformBlock::Directional, color) == 16, "std140 layout mismatch");
+static_assert(offsetof(FrameUniformBlock::Spot, direction) == 16, "std140 layout mismatch");
+static_assert(offsetof(FrameUniformBlock::Spot, intensity) == 28, "std140 layout mismatch");
+static_assert(offsetof(FrameUniformBlock::Spot, color) == 32, "std140 layout mismatch");
+static_assert(offsetof(FrameUniformBlock::Spot, angle) == 44, "std140 layout mismatch");
+static_assert(offsetof(FrameUniformBlock::Spot, kc) == 48, "std140 layout mismatch");
+static_assert(offsetof(FrameUniformBlock, clusters) == 256, "std140 layout mismatch");
+static_assert(offsetof(FrameUniformBlock, shadows) == 288, "std140 layout mismatch");
+static_assert(offsetof(FrameUniformBlock::Shadows, splits) == 256, "std140 layout mismatch");
+static_assert(CascadedShadowMap::maxCascades == 4, "the glsl block declares 4 cascades");
+static_assert(sizeof(FrameUniformBlock) == 576, "std140 layout mismatch");
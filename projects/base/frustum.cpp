@@ -0,0 +1,63 @@
+#include "frustum.h"
+#include "simd.h"
+
+bool Frustum::intersect(const BoundingBox& aabb, const glm::mat4& modelMatrix) const {
+    return intersect(aabb.transform(modelMatrix));
+}
+
+bool Frustum::intersect(const BoundingBox& aabb) const {
+    for (const auto& plane : planes) {
+        // the corner furthest along the normal, when it is behind the plane so is the box
+        const glm::vec3 corner(
+            plane.normal.x >= 0.0f ? aabb.max.x : aabb.min.x,
+            plane.normal.y >= 0.0f ? aabb.max.y : aabb.min.y,
+            plane.normal.z >= 0.0f ? aabb.max.z : aabb.min.z);
+        if (plane.getSignedDistanceToPoint(corner) < 0.0f) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void Frustum::cull(const BoundingBox* boxes, size_t count, std::vector<uint32_t>& visible) const {
+    size_t i = 0;
+
+#if defined(CG_SIMD_SSE2)
+    for (; i + 4 <= count; i += 4) {
+        const BoundingBox* b = boxes + i;
+        const __m128 minX = _mm_setr_ps(b[0].min.x, b[1].min.x, b[2].min.x, b[3].min.x);
+        const __m128 minY = _mm_setr_ps(b[0].min.y, b[1].min.y, b[2].min.y, b[3].min.y);
+        const __m128 minZ = _mm_setr_ps(b[0].min.z, b[1].min.z, b[2].min.z, b[3].min.z);
+        const __m128 maxX = _mm_setr_ps(b[0].max.x, b[1].max.x, b[2].max.x, b[3].max.x);
+        const __m128 maxY = _mm_setr_ps(b[0].max.y, b[1].max.y, b[2].max.y, b[3].max.y);
+        const __m128 maxZ = _mm_setr_ps(b[0].max.z, b[1].max.z, b[2].max.z, b[3].max.z);
+
+        // the sign of a normal is the same for the 4 boxes, so choosing the corner
+        // is a choice of register rather than a per lane blend
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (const auto& plane : planes) {
+            const glm::vec3& n = plane.normal;
+            const __m128 x = _mm_mul_ps(_mm_set1_ps(n.x), n.x >= 0.0f ? maxX : minX);
+            const __m128 y = _mm_mul_ps(_mm_set1_ps(n.y), n.y >= 0.0f ? maxY : minY);
+            const __m128 z = _mm_mul_ps(_mm_set1_ps(n.z), n.z >= 0.0f ? maxZ : minZ);
+            const __m128 distance = _mm_add_ps(
+                _mm_add_ps(_mm_add_ps(x, y), z), _mm_set1_ps(plane.signedDistance));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+        }
+
+        const int mask = _mm_movemask_ps(inside);
+        for (int lane = 0; lane < 4; ++lane) {
+            if (mask & (1 << lane)) {
+                visible.push_back(static_cast<uint32_t>(i + lane));
+            }
+        }
+    }
+#endif
+
+    for (; i < count; ++i) {
+        if (intersect(boxes[i])) {
+            visible.push_back(static_cast<uint32_t>(i));
+        }
+    }
+}
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
 #include "bounding_box.h"
 #include "plane.h"
-#include <iostream>
 
 struct Frustum {
 public:
@@ -16,14 +19,15 @@ public:
         FarFace = 5
     };
 
-    bool intersect(const BoundingBox& aabb, const glm::mat4& modelMatrix) const {
-        // TODO: judge whether the frustum intersects the bounding box
-        // Note: this is for Bonus project 'Frustum Culling'
-        // write your code here
-        // ------------------------------------------------------------
-        return true;
-        // ------------------------------------------------------------
-    }
+    // a box is rejected only when it lies entirely behind one of the planes, boxes
+    // near the corners of the frustum may pass although they are outside
+    bool intersect(const BoundingBox& aabb, const glm::mat4& modelMatrix) const;
+
+    bool intersect(const BoundingBox& aabb) const;
+
+    // tests world space boxes 4 at a time and appends the indices of the ones that pass
+    // intersect() to visible, in ascending order
+    void cull(const BoundingBox* boxes, size_t count, std::vector<uint32_t>& visible) const;
 };
 
 inline std::ostream& operator<<(std::ostream& os, const Frustum& frustum) {
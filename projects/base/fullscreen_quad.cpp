@@ -1,4 +1,5 @@
 #include "fullscreen_quad.h"
+#include "gl_state_cache.h"
 
 FullscreenQuad::FullscreenQuad() {
     float _vertices[] = {-1.0f, 1.0f,  0.0f, 1.0f, -1.0f, -1.0f, 0.0f, 0.0f,
@@ -8,8 +9,8 @@ FullscreenQuad::FullscreenQuad() {
     glGenVertexArrays(1, &_vao);
     glGenBuffers(1, &_vbo);
 
-    glBindVertexArray(_vao);
-    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+    GLStateCache::instance().bindVertexArray(_vao);
+    GLStateCache::instance().bindBuffer(GL_ARRAY_BUFFER, _vbo);
 
     glBufferData(GL_ARRAY_BUFFER, sizeof(_vertices), &_vertices, GL_STATIC_DRAW);
 
@@ -19,8 +20,8 @@ FullscreenQuad::FullscreenQuad() {
     glVertexAttribPointer(
         1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), reinterpret_cast<float*>(2 * sizeof(float)));
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    GLStateCache::instance().bindBuffer(GL_ARRAY_BUFFER, 0);
+    GLStateCache::instance().bindVertexArray(0);
 }
 
 FullscreenQuad::FullscreenQuad(FullscreenQuad&& rhs) noexcept : _vao(rhs._vao), _vbo(rhs._vbo) {
@@ -30,18 +31,19 @@ FullscreenQuad::FullscreenQuad(FullscreenQuad&& rhs) noexcept : _vao(rhs._vao),
 
 FullscreenQuad::~FullscreenQuad() {
     if (_vao) {
+        GLStateCache::instance().forgetVertexArray(_vao);
         glDeleteVertexArrays(1, &_vao);
         _vao = 0;
     }
 
     if (_vbo) {
+        GLStateCache::instance().forgetBuffer(_vbo);
         glDeleteBuffers(1, &_vbo);
         _vbo = 0;
     }
 }
 
 void FullscreenQuad::draw() const {
-    glBindVertexArray(_vao);
+    GLStateCache::instance().bindVertexArray(_vao);
     glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindVertexArray(0);
 }
\ No newline at end of file
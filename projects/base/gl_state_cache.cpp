@@ -0,0 +1,298 @@
+#include <algorithm>
+
+#include "gl_state_cache.h"
+
+namespace {
+
+int getBufferTargetIndex(GLenum target) {
+    switch (target) {
+    case GL_ARRAY_BUFFER: return 0;
+    case GL_UNIFORM_BUFFER: return 1;
+    case GL_TEXTURE_BUFFER: return 2;
+    case GL_COPY_READ_BUFFER: return 3;
+    case GL_COPY_WRITE_BUFFER: return 4;
+    case GL_PIXEL_PACK_BUFFER: return 5;
+    case GL_PIXEL_UNPACK_BUFFER: return 6;
+    default: return -1;
+    }
+}
+
+int getTextureTargetIndex(GLenum target) {
+    switch (target) {
+    case GL_TEXTURE_2D: return 0;
+    case GL_TEXTURE_2D_ARRAY: return 1;
+    case GL_TEXTURE_CUBE_MAP: return 2;
+    case GL_TEXTURE_3D: return 3;
+    case GL_TEXTURE_BUFFER: return 4;
+    default: return -1;
+    }
+}
+
+int getCapabilityIndex(GLenum capability) {
+    switch (capability) {
+    case GL_DEPTH_TEST: return 0;
+    case GL_BLEND: return 1;
+    case GL_CULL_FACE: return 2;
+    case GL_POLYGON_OFFSET_FILL: return 3;
+    case GL_SCISSOR_TEST: return 4;
+    case GL_STENCIL_TEST: return 5;
+    case GL_MULTISAMPLE: return 6;
+    default: return -1;
+    }
+}
+
+} // namespace
+
+constexpr GLuint GLStateCache::maxTextureUnits;
+constexpr GLuint GLStateCache::maxBufferBindings;
+constexpr GLuint GLStateCache::unknown;
+
+GLStateCache& GLStateCache::instance() {
+    static GLStateCache cache;
+    return cache;
+}
+
+GLStateCache::GLStateCache() {
+    invalidate();
+}
+
+void GLStateCache::beginFrame() {
+    _lastFrame = _frame;
+    _frame = Statistics();
+}
+
+const GLStateCache::Statistics& GLStateCache::getStatistics() const {
+    return _lastFrame;
+}
+
+void GLStateCache::invalidate() {
+    _program = unknown;
+    _vao = unknown;
+    std::fill(std::begin(_buffers), std::end(_buffers), unknown);
+    std::fill(std::begin(_uniformBuffers), std::end(_uniformBuffers), unknown);
+    _activeUnit = unknown;
+    for (auto& unit : _textures) {
+        std::fill(std::begin(unit), std::end(unit), unknown);
+    }
+    std::fill(std::begin(_samplers), std::end(_samplers), unknown);
+
+    std::fill(std::begin(_capabilities), std::end(_capabilities), -1);
+    _depthMask = -1;
+    _colorMask = -1;
+    _depthFunc = unknown;
+    _blendSource = unknown;
+    _blendDestination = unknown;
+    _cullFace = unknown;
+    _polygonMode = unknown;
+    _polygonOffsetKnown = false;
+}
+
+void GLStateCache::useProgram(GLuint program) {
+    if (skip(_program == program)) {
+        return;
+    }
+
+    glUseProgram(program);
+    _program = program;
+}
+
+void GLStateCache::bindVertexArray(GLuint vao) {
+    if (skip(_vao == vao)) {
+        return;
+    }
+
+    glBindVertexArray(vao);
+    _vao = vao;
+}
+
+void GLStateCache::bindBuffer(GLenum target, GLuint buffer) {
+    const int index = getBufferTargetIndex(target);
+    if (skip(index >= 0 && _buffers[index] == buffer)) {
+        return;
+    }
+
+    glBindBuffer(target, buffer);
+    if (index >= 0) {
+        _buffers[index] = buffer;
+    }
+}
+
+void GLStateCache::bindBufferBase(GLenum target, GLuint index, GLuint buffer) {
+    // binding a range also binds the generic target
+    const bool tracked = target == GL_UNIFORM_BUFFER && index < maxBufferBindings;
+    if (skip(tracked && _uniformBuffers[index] == buffer &&
+             _buffers[getBufferTargetIndex(target)] == buffer)) {
+        return;
+    }
+
+    glBindBufferBase(target, index, buffer);
+    if (tracked) {
+        _uniformBuffers[index] = buffer;
+    }
+    const int targetIndex = getBufferTargetIndex(target);
+    if (targetIndex >= 0) {
+        _buffers[targetIndex] = buffer;
+    }
+}
+
+void GLStateCache::activeTexture(GLuint unit) {
+    if (skip(_activeUnit == unit)) {
+        return;
+    }
+
+    glActiveTexture(GL_TEXTURE0 + unit);
+    _activeUnit = unit;
+}
+
+void GLStateCache::bindTexture(GLenum target, GLuint texture) {
+    const int index = getTextureTargetIndex(target);
+    const bool tracked = index >= 0 && _activeUnit < maxTextureUnits;
+    if (skip(tracked && _textures[_activeUnit][index] == texture)) {
+        return;
+    }
+
+    glBindTexture(target, texture);
+    if (tracked) {
+        _textures[_activeUnit][index] = texture;
+    }
+}
+
+void GLStateCache::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+    // the unit switch is kept even when the bind is skipped, callers edit the texture on
+    // the active unit right after binding it
+    activeTexture(unit);
+    bindTexture(target, texture);
+}
+
+void GLStateCache::bindSampler(GLuint unit, GLuint sampler) {
+    const bool tracked = unit < maxTextureUnits;
+    if (skip(tracked && _samplers[unit] == sampler)) {
+        return;
+    }
+
+    glBindSampler(unit, sampler);
+    if (tracked) {
+        _samplers[unit] = sampler;
+    }
+}
+
+void GLStateCache::setEnabled(GLenum capability, bool enabled) {
+    const int index = getCapabilityIndex(capability);
+    if (skip(index >= 0 && _capabilities[index] == static_cast<int8_t>(enabled))) {
+        return;
+    }
+
+    if (enabled) {
+        glEnable(capability);
+    } else {
+        glDisable(capability);
+    }
+    if (index >= 0) {
+        _capabilities[index] = static_cast<int8_t>(enabled);
+    }
+}
+
+void GLStateCache::depthFunc(GLenum func) {
+    if (skip(_depthFunc == func)) {
+        return;
+    }
+
+    glDepthFunc(func);
+    _depthFunc = func;
+}
+
+void GLStateCache::depthMask(bool enabled) {
+    if (skip(_depthMask == static_cast<int8_t>(enabled))) {
+        return;
+    }
+
+    glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+    _depthMask = static_cast<int8_t>(enabled);
+}
+
+void GLStateCache::colorMask(bool red, bool green, bool blue, bool alpha) {
+    const int8_t mask = static_cast<int8_t>(red | (green << 1) | (blue << 2) | (alpha << 3));
+    if (skip(_colorMask == mask)) {
+        return;
+    }
+
+    glColorMask(red, green, blue, alpha);
+    _colorMask = mask;
+}
+
+void GLStateCache::blendFunc(GLenum source, GLenum destination) {
+    if (skip(_blendSource == source && _blendDestination == destination)) {
+        return;
+    }
+
+    glBlendFunc(source, destination);
+    _blendSource = source;
+    _blendDestination = destination;
+}
+
+void GLStateCache::cullFace(GLenum mode) {
+    if (skip(_cullFace == mode)) {
+        return;
+    }
+
+    glCullFace(mode);
+    _cullFace = mode;
+}
+
+void GLStateCache::polygonMode(GLenum mode) {
+    if (skip(_polygonMode == mode)) {
+        return;
+    }
+
+    glPolygonMode(GL_FRONT_AND_BACK, mode);
+    _polygonMode = mode;
+}
+
+void GLStateCache::polygonOffset(float factor, float units) {
+    if (skip(_polygonOffsetKnown && _polygonOffsetFactor == factor &&
+             _polygonOffsetUnits == units)) {
+        return;
+    }
+
+    glPolygonOffset(factor, units);
+    _polygonOffsetFactor = factor;
+    _polygonOffsetUnits = units;
+    _polygonOffsetKnown = true;
+}
+
+void GLStateCache::forgetProgram(GLuint program) {
+    if (_program == program) {
+        _program = unknown;
+    }
+}
+
+void GLStateCache::forgetVertexArray(GLuint vao) {
+    if (_vao == vao) {
+        _vao = unknown;
+    }
+}
+
+void GLStateCache::forgetBuffer(GLuint buffer) {
+    std::replace(std::begin(_buffers), std::end(_buffers), buffer, unknown);
+    std::replace(std::begin(_uniformBuffers), std::end(_uniformBuffers), buffer, unknown);
+}
+
+void GLStateCache::forgetTexture(GLuint texture) {
+    for (auto& unit : _textures) {
+        std::replace(std::begin(unit), std::end(unit), texture, unknown);
+    }
+}
+
+void GLStateCache::forgetSampler(GLuint sampler) {
+    std::replace(std::begin(_samplers), std::end(_samplers), sampler, unknown);
+}
+
+bool GLStateCache::skip(bool unchanged) {
+    if (unchanged) {
+        ++_frame.skipped;
+    } else {
+        ++_frame.issued;
+    }
+
+    return unchanged;
+}
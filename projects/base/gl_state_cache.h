@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "gl_utility.h"
+
+// shadow copy of the gl state the renderer touches, calls that would set the value
+// already in place are dropped. the copy is only right as long as every bind of a
+// program, vertex array, buffer, texture or sampler and every change of the depth,
+// blend and raster state below goes through here. imgui restores whatever it changes,
+// other foreign code has to be followed by invalidate()
+class GLStateCache {
+public:
+    struct Statistics {
+        size_t issued = 0;
+        size_t skipped = 0;
+    };
+
+    static constexpr GLuint maxTextureUnits = 16;
+    static constexpr GLuint maxBufferBindings = 16;
+
+    // there is one gl context per application
+    static GLStateCache& instance();
+
+    GLStateCache(const GLStateCache&) = delete;
+
+    GLStateCache& operator=(const GLStateCache&) = delete;
+
+    // the counters of the frame that just ended become the statistics
+    void beginFrame();
+
+    const Statistics& getStatistics() const;
+
+    // marks everything unknown, the next call of each kind is issued
+    void invalidate();
+
+    void useProgram(GLuint program);
+
+    void bindVertexArray(GLuint vao);
+
+    // the element array binding is part of the bound vertex array, it is never skipped
+    void bindBuffer(GLenum target, GLuint buffer);
+
+    void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+
+    void activeTexture(GLuint unit);
+
+    // binds to the active unit
+    void bindTexture(GLenum target, GLuint texture);
+
+    // makes unit the active one and binds to it
+    void bindTexture(GLuint unit, GLenum target, GLuint texture);
+
+    void bindSampler(GLuint unit, GLuint sampler);
+
+    void setEnabled(GLenum capability, bool enabled);
+
+    void depthFunc(GLenum func);
+
+    void depthMask(bool enabled);
+
+    void colorMask(bool red, bool green, bool blue, bool alpha);
+
+    void blendFunc(GLenum source, GLenum destination);
+
+    void cullFace(GLenum mode);
+
+    // for front and back faces
+    void polygonMode(GLenum mode);
+
+    void polygonOffset(float factor, float units);
+
+    // gl hands deleted names out again, so they must not stay in the shadow copy
+    void forgetProgram(GLuint program);
+
+    void forgetVertexArray(GLuint vao);
+
+    void forgetBuffer(GLuint buffer);
+
+    void forgetTexture(GLuint texture);
+
+    void forgetSampler(GLuint sampler);
+
+private:
+    static constexpr GLuint unknown = ~0u;
+    static constexpr int bufferTargetCount = 7;
+    static constexpr int textureTargetCount = 5;
+    static constexpr int capabilityCount = 7;
+
+    GLStateCache();
+
+    Statistics _frame;
+    Statistics _lastFrame;
+
+    GLuint _program = unknown;
+    GLuint _vao = unknown;
+    GLuint _buffers[bufferTargetCount];
+    GLuint _uniformBuffers[maxBufferBindings];
+    GLuint _activeUnit = unknown;
+    GLuint _textures[maxTextureUnits][textureTargetCount];
+    GLuint _samplers[maxTextureUnits];
+
+    // -1 while unknown
+    int8_t _capabilities[capabilityCount];
+    int8_t _depthMask = -1;
+    int8_t _colorMask = -1; // one bit per channel
+    GLenum _depthFunc = unknown;
+    GLenum _blendSource = unknown;
+    GLenum _blendDestination = unknown;
+    GLenum _cullFace = unknown;
+    GLenum _polygonMode = unknown;
+    float _polygonOffsetFactor = 0.0f;
+    float _polygonOffsetUnits = 0.0f;
+    bool _polygonOffsetKnown = false;
+
+    // counts the call, true when it changes nothing
+    bool skip(bool unchanged);
+};
@@ -26,4 +26,18 @@ inline GLenum implCheckGLErrors(const char* file, int line) {
     return errorCode;
 }
 
-#define checkGLErrors() implCheckGLErrors(__FILE__, __LINE__)
\ No newline at end of file
+#define checkGLErrors() implCheckGLErrors(__FILE__, __LINE__)
+
+inline bool hasGLExtension(const std::string& name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        const char* extension =
+            reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+        if (extension != nullptr && name == extension) {
+            return true;
+        }
+    }
+
+    return false;
+}
\ No newline at end of file
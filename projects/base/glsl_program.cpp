@@ -1,121 +1,254 @@
+#include <algorithm>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <regex>
 #include <sstream>
 #include <stdexcept>
+#include <thread>
 
 #include <glm/ext.hpp>
 
+#include "gl_state_cache.h"
 #include "glsl_program.h"
 
+#ifdef _WIN32
+    #include <direct.h>
+#else
+    #include <sys/stat.h>
+#endif
+
+namespace {
+
+std::string toHex(uint64_t value) {
+    std::stringstream ss;
+    ss << std::hex << std::setw(16) << std::setfill('0') << value;
+    return ss.str();
+}
+
+void makeDirectory(const std::string& path) {
+    // an existing directory is fine, a failure shows up when the first binary is written
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+} // namespace
+
+#ifndef GL_COMPLETION_STATUS_KHR
+    #define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+constexpr uint32_t GLSLProgram::binaryCacheVersion;
+constexpr uint64_t GLSLProgram::maxBinarySize;
+
+std::string GLSLProgram::_binaryCacheDirectory;
+
+std::unordered_set<const GLSLProgram*> GLSLProgram::_programs;
+
 GLSLProgram::GLSLProgram() {
     _handle = glCreateProgram();
     if (_handle == 0) {
         throw std::runtime_error("create glsl program failure");
     }
+
+    _programs.insert(this);
 }
 
 GLSLProgram::GLSLProgram(GLSLProgram&& rhs) noexcept
-    : _handle(rhs._handle), _vertexShaders(std::move(rhs._vertexShaders)),
-      _geometryShaders(std::move(rhs._geometryShaders)),
-      _fragmentShaders(std::move(rhs._fragmentShaders)) {
+    : _handle(rhs._handle), _uniforms(std::move(rhs._uniforms)),
+      _missingUniforms(std::move(rhs._missingUniforms)), _sources(std::move(rhs._sources)),
+      _feedbackVaryings(std::move(rhs._feedbackVaryings)),
+      _feedbackBufferMode(rhs._feedbackBufferMode), _shaders(std::move(rhs._shaders)),
+      _cachePath(std::move(rhs._cachePath)), _linkedFromCache(rhs._linkedFromCache) {
     rhs._handle = 0;
-    rhs._vertexShaders.clear();
-    rhs._geometryShaders.clear();
-    rhs._fragmentShaders.clear();
+    rhs._shaders.clear();
+    _programs.insert(this);
 }
 
 GLSLProgram::~GLSLProgram() {
-    for (const auto vertexShader : _vertexShaders) {
-        glDeleteShader(vertexShader);
-    }
+    _programs.erase(this);
 
-    for (const auto geometryShader : _geometryShaders) {
-        glDeleteShader(geometryShader);
-    }
-
-    for (const auto fragmentShader : _fragmentShaders) {
-        glDeleteShader(fragmentShader);
+    for (const auto shader : _shaders) {
+        glDeleteShader(shader);
     }
 
     if (_handle) {
+        GLStateCache::instance().forgetProgram(_handle);
         glDeleteProgram(_handle);
         _handle = 0;
     }
 }
 
 void GLSLProgram::attachVertexShader(const std::string& code) {
-    GLuint vertexShader = createShader(code, GL_VERTEX_SHADER);
-    glAttachShader(_handle, vertexShader);
-    _vertexShaders.push_back(vertexShader);
+    _sources.push_back({GL_VERTEX_SHADER, code, ""});
 }
 
 void GLSLProgram::attachGeometryShader(const std::string& code) {
-    GLuint geometryShader = createShader(code, GL_GEOMETRY_SHADER);
-    glAttachShader(_handle, geometryShader);
-    _geometryShaders.push_back(geometryShader);
+    _sources.push_back({GL_GEOMETRY_SHADER, code, ""});
 }
 
 void GLSLProgram::attachFragmentShader(const std::string& code) {
-    GLuint fragmentShader = createShader(code, GL_FRAGMENT_SHADER);
-    glAttachShader(_handle, fragmentShader);
-    _fragmentShaders.push_back(fragmentShader);
+    _sources.push_back({GL_FRAGMENT_SHADER, code, ""});
 }
 
 void GLSLProgram::attachVertexShaderFromFile(const std::string& filePath) {
-    const std::string& code = readFile(filePath);
-    try {
-        attachVertexShader(code);
-    } catch (const std::runtime_error&) {
-        std::cerr << "Compile " << filePath << " error" << std::endl;
-        throw;
-    }
+    _sources.push_back({GL_VERTEX_SHADER, readFile(filePath), filePath});
 }
 
 void GLSLProgram::attachGeometryShaderFromFile(const std::string& filePath) {
-    const std::string& code = readFile(filePath);
-    try {
-        attachGeometryShader(code);
-    } catch (const std::runtime_error&) {
-        std::cerr << "Compile " << filePath << " error" << std::endl;
-        throw;
-    }
+    _sources.push_back({GL_GEOMETRY_SHADER, readFile(filePath), filePath});
 }
 
 void GLSLProgram::attachFragmentShaderFromFile(const std::string& filePath) {
-    const std::string& code = readFile(filePath);
-    try {
-        attachFragmentShader(code);
-    } catch (const std::runtime_error&) {
-        std::cerr << "Compile " << filePath << " error" << std::endl;
-        throw;
-    }
+    _sources.push_back({GL_FRAGMENT_SHADER, readFile(filePath), filePath});
 }
 
 void GLSLProgram::setTransformFeedbackVaryings(
     const std::vector<const char*>& varyings, GLenum bufferMode) {
     glTransformFeedbackVaryings(
         _handle, static_cast<GLsizei>(varyings.size()), varyings.data(), bufferMode);
+    _feedbackVaryings.assign(varyings.begin(), varyings.end());
+    _feedbackBufferMode = bufferMode;
 }
 
 void GLSLProgram::link() {
-    glLinkProgram(_handle);
+    beginLink();
+    finishLink();
+}
 
-    GLint success;
-    glGetProgramiv(_handle, GL_LINK_STATUS, &success);
-    if (!success) {
-        char buffer[1024];
-        glGetProgramInfoLog(_handle, sizeof(buffer), NULL, buffer);
-        throw std::runtime_error("link program error: " + std::string(buffer));
+void GLSLProgram::beginLink() {
+    _cachePath = isBinaryCacheEnabled()
+                     ? _binaryCacheDirectory + toHex(computeCacheKey()) + ".bin"
+                     : std::string();
+
+    _linkedFromCache = !_cachePath.empty() && loadBinary(_cachePath);
+    if (!_linkedFromCache) {
+        submitCompileAndLink(!_cachePath.empty());
+    }
+}
+
+bool GLSLProgram::isLinkComplete() const {
+    // without the extension any status query waits for the compiler, so report done
+    if (_shaders.empty() || !isParallelCompileSupported()) {
+        return true;
+    }
+
+    GLint complete = GL_FALSE;
+    glGetProgramiv(_handle, GL_COMPLETION_STATUS_KHR, &complete);
+    return complete == GL_TRUE;
+}
+
+void GLSLProgram::finishLink() {
+    if (!_linkedFromCache) {
+        checkCompileAndLink();
+        if (!_cachePath.empty()) {
+            storeBinary(_cachePath);
+        }
     }
+
+    reflectUniforms();
+}
+
+void GLSLProgram::linkAll(const std::vector<GLSLProgram*>& programs) {
+    for (GLSLProgram* program : programs) {
+        program->beginLink();
+    }
+
+    finishLinks(programs);
+}
+
+void GLSLProgram::finishLinks(const std::vector<GLSLProgram*>& programs) {
+    // finish programs in the order the compiler threads complete them
+    std::vector<GLSLProgram*> pending = programs;
+    while (!pending.empty()) {
+        auto complete = std::stable_partition(
+            pending.begin(), pending.end(),
+            [](const GLSLProgram* program) { return !program->isLinkComplete(); });
+
+        if (complete == pending.end()) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        for (auto it = complete; it != pending.end(); ++it) {
+            (*it)->finishLink();
+        }
+        pending.erase(complete, pending.end());
+    }
+}
+
+bool GLSLProgram::isParallelCompileSupported() {
+    // both extensions share the enum, the compiler thread count is left to the driver
+    static const bool supported = hasGLExtension("GL_KHR_parallel_shader_compile") ||
+                                  hasGLExtension("GL_ARB_parallel_shader_compile");
+    return supported;
+}
+
+bool GLSLProgram::isLinkedFromCache() const {
+    return _linkedFromCache;
+}
+
+void GLSLProgram::setBinaryCacheDirectory(const std::string& directory) {
+    _binaryCacheDirectory = directory;
+    if (!directory.empty() && directory.back() != '/' && directory.back() != '\\') {
+        _binaryCacheDirectory += '/';
+    }
+
+    if (!_binaryCacheDirectory.empty()) {
+        makeDirectory(_binaryCacheDirectory);
+    }
+}
+
+bool GLSLProgram::isBinaryCacheEnabled() {
+    if (_binaryCacheDirectory.empty() || glGetProgramBinary == nullptr ||
+        glProgramBinary == nullptr || glProgramParameteri == nullptr) {
+        return false;
+    }
+
+    // a driver may support the entry points without offering a single format
+    GLint formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    return formatCount > 0;
+}
+
+void GLSLProgram::prewarm() {
+    // core profile draws need a vertex array, an empty one feeds the default attributes
+    GLuint vao = 0;
+    glGenVertexArrays(1, &vao);
+    GLStateCache::instance().bindVertexArray(vao);
+    GLStateCache::instance().setEnabled(GL_RASTERIZER_DISCARD, true);
+
+    for (const GLSLProgram* program : _programs) {
+        GLint linked = GL_FALSE;
+        if (program->_handle != 0) {
+            glGetProgramiv(program->_handle, GL_LINK_STATUS, &linked);
+        }
+        if (linked == GL_TRUE) {
+            GLStateCache::instance().useProgram(program->_handle);
+            glDrawArrays(GL_POINTS, 0, 1);
+        }
+    }
+
+    GLStateCache::instance().setEnabled(GL_RASTERIZER_DISCARD, false);
+    GLStateCache::instance().bindVertexArray(0);
+    GLStateCache::instance().forgetVertexArray(vao);
+    glDeleteVertexArrays(1, &vao);
 }
 
 void GLSLProgram::use() {
-    glUseProgram(_handle);
+    GLStateCache::instance().useProgram(_handle);
 }
 
 void GLSLProgram::unuse() {
-    glUseProgram(0);
+    GLStateCache::instance().useProgram(0);
+}
+
+GLint GLSLProgram::getUniformLocation(const std::string& name) const {
+    const UniformInfo* uniform = findUniform(name);
+    return uniform != nullptr ? uniform->location : -1;
 }
 
 int GLSLProgram::getUniformBlockSize(const std::string& name) const {
@@ -154,91 +287,61 @@ int GLSLProgram::getUniformBlockVariableOffset(const std::string& name) const {
 }
 
 void GLSLProgram::setUniformBool(const std::string& name, bool value) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
-    }
+    GLint location = findUniformLocation(name);
 
     glUniform1i(location, static_cast<int>(value));
 }
 
 void GLSLProgram::setUniformInt(const std::string& name, int value) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
-    }
+    GLint location = findUniformLocation(name);
 
     glUniform1i(location, value);
 }
 
 void GLSLProgram::setUniformUint(const std::string& name, uint32_t value) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
-    }
+    GLint location = findUniformLocation(name);
 
     glUniform1ui(location, value);
 }
 
 void GLSLProgram::setUniformFloat(const std::string& name, float value) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
-    }
+    GLint location = findUniformLocation(name);
 
     glUniform1f(location, value);
 }
 
 void GLSLProgram::setUniformVec2(const std::string& name, const glm::vec2& v2) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
-    }
+    GLint location = findUniformLocation(name);
 
     glUniform2fv(location, 1, glm::value_ptr(v2));
 }
 
 void GLSLProgram::setUniformVec3(const std::string& name, const glm::vec3& v3) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
-    }
+    GLint location = findUniformLocation(name);
 
     glUniform3fv(location, 1, glm::value_ptr(v3));
 }
 
 void GLSLProgram::setUniformVec4(const std::string& name, const glm::vec4& v4) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
-    }
+    GLint location = findUniformLocation(name);
 
     glUniform4fv(location, 1, glm::value_ptr(v4));
 }
 
 void GLSLProgram::setUniformMat2(const std::string& name, const glm::mat2& mat2) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
-    }
+    GLint location = findUniformLocation(name);
 
-    glUniform3fv(location, 1, glm::value_ptr(mat2));
+    glUniformMatrix2fv(location, 1, GL_FALSE, glm::value_ptr(mat2));
 }
 
 void GLSLProgram::setUniformMat3(const std::string& name, const glm::mat3& mat3) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
-    }
+    GLint location = findUniformLocation(name);
 
-    glUniform3fv(location, 1, glm::value_ptr(mat3));
+    glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(mat3));
 }
 
 void GLSLProgram::setUniformMat4(const std::string& name, const glm::mat4& mat4) const {
-    GLint location = glGetUniformLocation(_handle, name.c_str());
-    if (location == -1) {
-        std::cerr << "find uniform " + name + " location failure" << std::endl;
-    }
+    GLint location = findUniformLocation(name);
 
     glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(mat4));
 }
@@ -252,6 +355,46 @@ void GLSLProgram::setUniformBlockBinding(const std::string& name, uint32_t bindi
     glUniformBlockBinding(_handle, blockIndex, binding);
 }
 
+void GLSLProgram::setUniform(UniformHandle<bool> handle, bool value) const {
+    glUniform1i(handle.getLocation(), static_cast<int>(value));
+}
+
+void GLSLProgram::setUniform(UniformHandle<int> handle, int value) const {
+    glUniform1i(handle.getLocation(), value);
+}
+
+void GLSLProgram::setUniform(UniformHandle<uint32_t> handle, uint32_t value) const {
+    glUniform1ui(handle.getLocation(), value);
+}
+
+void GLSLProgram::setUniform(UniformHandle<float> handle, float value) const {
+    glUniform1f(handle.getLocation(), value);
+}
+
+void GLSLProgram::setUniform(UniformHandle<glm::vec2> handle, const glm::vec2& v2) const {
+    glUniform2fv(handle.getLocation(), 1, glm::value_ptr(v2));
+}
+
+void GLSLProgram::setUniform(UniformHandle<glm::vec3> handle, const glm::vec3& v3) const {
+    glUniform3fv(handle.getLocation(), 1, glm::value_ptr(v3));
+}
+
+void GLSLProgram::setUniform(UniformHandle<glm::vec4> handle, const glm::vec4& v4) const {
+    glUniform4fv(handle.getLocation(), 1, glm::value_ptr(v4));
+}
+
+void GLSLProgram::setUniform(UniformHandle<glm::mat2> handle, const glm::mat2& mat2) const {
+    glUniformMatrix2fv(handle.getLocation(), 1, GL_FALSE, glm::value_ptr(mat2));
+}
+
+void GLSLProgram::setUniform(UniformHandle<glm::mat3> handle, const glm::mat3& mat3) const {
+    glUniformMatrix3fv(handle.getLocation(), 1, GL_FALSE, glm::value_ptr(mat3));
+}
+
+void GLSLProgram::setUniform(UniformHandle<glm::mat4> handle, const glm::mat4& mat4) const {
+    glUniformMatrix4fv(handle.getLocation(), 1, GL_FALSE, glm::value_ptr(mat4));
+}
+
 std::string GLSLProgram::readFile(const std::string& filePath) {
     std::ifstream is;
     is.exceptions(std::ifstream::failbit | std::ifstream::badbit);
@@ -267,24 +410,253 @@ std::string GLSLProgram::readFile(const std::string& filePath) {
     }
 }
 
+void GLSLProgram::submitCompileAndLink(bool retrievable) {
+    // nothing here queries a status, so the driver is free to compile in the background
+    for (const auto& source : _sources) {
+        GLuint shader = createShader(source.code, source.type);
+        glAttachShader(_handle, shader);
+        _shaders.push_back(shader);
+    }
+
+    if (retrievable) {
+        glProgramParameteri(_handle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glLinkProgram(_handle);
+}
+
+void GLSLProgram::checkCompileAndLink() {
+    // the linked program keeps the executable, the shader objects are no longer needed
+    auto release = [this]() {
+        for (const auto shader : _shaders) {
+            glDetachShader(_handle, shader);
+            glDeleteShader(shader);
+        }
+        _shaders.clear();
+    };
+
+    for (size_t i = 0; i < _shaders.size(); ++i) {
+        GLint success;
+        glGetShaderiv(_shaders[i], GL_COMPILE_STATUS, &success);
+        if (!success) {
+            char buffer[1024];
+            glGetShaderInfoLog(_shaders[i], sizeof(buffer), nullptr, buffer);
+            std::cerr << _sources[i].code << std::endl;
+            if (!_sources[i].filePath.empty()) {
+                std::cerr << "Compile " << _sources[i].filePath << " error" << std::endl;
+            }
+            release();
+            throw std::runtime_error("compile error: \n" + std::string(buffer));
+        }
+    }
+
+    release();
+
+    GLint success;
+    glGetProgramiv(_handle, GL_LINK_STATUS, &success);
+    if (!success) {
+        char buffer[1024];
+        glGetProgramInfoLog(_handle, sizeof(buffer), NULL, buffer);
+        throw std::runtime_error("link program error: " + std::string(buffer));
+    }
+}
+
+uint64_t GLSLProgram::computeCacheKey() const {
+    // fnv-1a over the driver identity and everything that goes into the link
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    };
+    auto mixString = [&mix](const char* text) {
+        const std::string value = text != nullptr ? text : "";
+        mix(value.c_str(), value.size() + 1);
+    };
+
+    mix(&binaryCacheVersion, sizeof(binaryCacheVersion));
+    mixString(reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+    mixString(reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+    mixString(reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+
+    for (const auto& source : _sources) {
+        mix(&source.type, sizeof(source.type));
+        mixString(source.code.c_str());
+    }
+
+    for (const auto& varying : _feedbackVaryings) {
+        mixString(varying.c_str());
+    }
+    mix(&_feedbackBufferMode, sizeof(_feedbackBufferMode));
+
+    return hash;
+}
+
+bool GLSLProgram::loadBinary(const std::string& path) {
+    std::ifstream is(path, std::ios::binary);
+    if (!is) {
+        return false;
+    }
+
+    uint32_t version = 0;
+    GLenum format = 0;
+    uint64_t size = 0;
+    is.read(reinterpret_cast<char*>(&version), sizeof(version));
+    is.read(reinterpret_cast<char*>(&format), sizeof(format));
+    is.read(reinterpret_cast<char*>(&size), sizeof(size));
+    if (!is || version != binaryCacheVersion || size == 0 || size > maxBinarySize) {
+        return false;
+    }
+
+    std::vector<char> binary(static_cast<size_t>(size));
+    if (!is.read(binary.data(), binary.size())) {
+        return false;
+    }
+
+    // a driver update may reject an older binary, the caller compiles from source then
+    glProgramBinary(_handle, format, binary.data(), static_cast<GLsizei>(binary.size()));
+    GLint success = GL_FALSE;
+    glGetProgramiv(_handle, GL_LINK_STATUS, &success);
+
+    return success == GL_TRUE;
+}
+
+void GLSLProgram::storeBinary(const std::string& path) const {
+    GLint length = 0;
+    glGetProgramiv(_handle, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    std::vector<char> binary(static_cast<size_t>(length));
+    GLenum format = 0;
+    glGetProgramBinary(_handle, length, nullptr, &format, binary.data());
+
+    std::ofstream os(path, std::ios::binary | std::ios::trunc);
+    if (!os) {
+        std::cerr << "cannot write the program binary " << path << std::endl;
+        return;
+    }
+
+    const uint32_t version = binaryCacheVersion;
+    const uint64_t size = binary.size();
+    os.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    os.write(reinterpret_cast<const char*>(&format), sizeof(format));
+    os.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    os.write(binary.data(), binary.size());
+}
+
 GLuint GLSLProgram::createShader(const std::string& code, GLenum shaderType) {
     GLuint shader = glCreateShader(shaderType);
     if (shader == 0) {
         throw std::runtime_error("create shader failure");
     }
 
+    // the status is checked by checkCompileAndLink()
     const char* codeBuf = code.c_str();
     glShaderSource(shader, 1, &codeBuf, nullptr);
     glCompileShader(shader);
 
-    GLint success;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        char buffer[1024];
-        glGetShaderInfoLog(shader, sizeof(buffer), nullptr, buffer);
-        std::cerr << code << std::endl;
-        throw std::runtime_error("compile error: \n" + std::string(buffer));
+    return shader;
+}
+
+void GLSLProgram::reflectUniforms() {
+    _uniforms.clear();
+    _missingUniforms.clear();
+
+    GLint count = 0;
+    glGetProgramiv(_handle, GL_ACTIVE_UNIFORMS, &count);
+    GLint maxLength = 0;
+    glGetProgramiv(_handle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    std::vector<char> buffer(std::max(maxLength, 1));
+    for (GLint i = 0; i < count; ++i) {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(
+            _handle, static_cast<GLuint>(i), static_cast<GLsizei>(buffer.size()), &length, &size,
+            &type, buffer.data());
+        std::string name(buffer.data(), length);
+
+        // members of uniform blocks have no location
+        const GLint location = glGetUniformLocation(_handle, name.c_str());
+        if (location == -1) {
+            continue;
+        }
+
+        // arrays are reported as "name[0]", they are reachable as "name" as well
+        const size_t bracket = name.rfind("[0]");
+        if (bracket != std::string::npos && bracket + 3 == name.size()) {
+            const std::string base = name.substr(0, bracket);
+            _uniforms.push_back({base, location, type});
+            for (GLint element = 0; element < size; ++element) {
+                const std::string elementName = base + "[" + std::to_string(element) + "]";
+                _uniforms.push_back(
+                    {elementName, glGetUniformLocation(_handle, elementName.c_str()), type});
+            }
+        } else {
+            _uniforms.push_back({name, location, type});
+        }
     }
 
-    return shader;
-}
\ No newline at end of file
+    std::sort(_uniforms.begin(), _uniforms.end(), [](const UniformInfo& a, const UniformInfo& b) {
+        return a.name < b.name;
+    });
+}
+
+const GLSLProgram::UniformInfo* GLSLProgram::findUniform(const std::string& name) const {
+    auto it = std::lower_bound(
+        _uniforms.begin(), _uniforms.end(), name,
+        [](const UniformInfo& uniform, const std::string& key) { return uniform.name < key; });
+    if (it == _uniforms.end() || it->name != name) {
+        return nullptr;
+    }
+
+    return &*it;
+}
+
+GLint GLSLProgram::findUniformLocation(const std::string& name) const {
+    const UniformInfo* uniform = findUniform(name);
+    if (uniform == nullptr) {
+        if (_missingUniforms.insert(name).second) {
+            std::cerr << "find uniform " + name + " location failure" << std::endl;
+        }
+        return -1;
+    }
+
+    return uniform->location;
+}
+
+GLint GLSLProgram::resolveUniform(const std::string& name, GLenum type) const {
+    const UniformInfo* uniform = findUniform(name);
+    if (uniform == nullptr) {
+        // inactive, e.g. optimized away, the handle sets nothing
+        return -1;
+    }
+
+    bool matches = uniform->type == type;
+    if (type == GL_INT) {
+        switch (uniform->type) {
+        case GL_SAMPLER_1D:
+        case GL_SAMPLER_2D:
+        case GL_SAMPLER_3D:
+        case GL_SAMPLER_CUBE:
+        case GL_SAMPLER_2D_SHADOW:
+        case GL_SAMPLER_2D_ARRAY:
+        case GL_SAMPLER_2D_ARRAY_SHADOW:
+        case GL_SAMPLER_BUFFER:
+        case GL_INT_SAMPLER_BUFFER:
+        case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+        case GL_INT_SAMPLER_2D:
+        case GL_UNSIGNED_INT_SAMPLER_2D: matches = true; break;
+        default: break;
+        }
+    }
+
+    if (!matches) {
+        throw std::runtime_error("uniform " + name + " is declared with another type");
+    }
+
+    return uniform->location;
+}
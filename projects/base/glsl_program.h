@@ -1,12 +1,89 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 #include <glm/glm.hpp>
 
 #include "gl_utility.h"
 
+// location of a uniform resolved once after linking, setting it through the handle
+// involves no name lookup. an invalid handle (the uniform is not active) sets nothing
+template <typename T>
+class UniformHandle {
+public:
+    UniformHandle() = default;
+
+    explicit UniformHandle(GLint location) : _location(location) {}
+
+    GLint getLocation() const {
+        return _location;
+    }
+
+    bool isValid() const {
+        return _location != -1;
+    }
+
+private:
+    GLint _location = -1;
+};
+
+// glsl type a handle of T may refer to
+template <typename T>
+struct UniformType;
+
+template <>
+struct UniformType<bool> {
+    static constexpr GLenum value = GL_BOOL;
+};
+
+template <>
+struct UniformType<int> {
+    static constexpr GLenum value = GL_INT; // samplers are set as int as well
+};
+
+template <>
+struct UniformType<uint32_t> {
+    static constexpr GLenum value = GL_UNSIGNED_INT;
+};
+
+template <>
+struct UniformType<float> {
+    static constexpr GLenum value = GL_FLOAT;
+};
+
+template <>
+struct UniformType<glm::vec2> {
+    static constexpr GLenum value = GL_FLOAT_VEC2;
+};
+
+template <>
+struct UniformType<glm::vec3> {
+    static constexpr GLenum value = GL_FLOAT_VEC3;
+};
+
+template <>
+struct UniformType<glm::vec4> {
+    static constexpr GLenum value = GL_FLOAT_VEC4;
+};
+
+template <>
+struct UniformType<glm::mat2> {
+    static constexpr GLenum value = GL_FLOAT_MAT2;
+};
+
+template <>
+struct UniformType<glm::mat3> {
+    static constexpr GLenum value = GL_FLOAT_MAT3;
+};
+
+template <>
+struct UniformType<glm::mat4> {
+    static constexpr GLenum value = GL_FLOAT_MAT4;
+};
+
 class GLSLProgram {
 public:
     GLSLProgram();
@@ -29,12 +106,55 @@ public:
 
     void setTransformFeedbackVaryings(const std::vector<const char*>& varyings, GLenum bufferMode);
 
+    // compiles the attached sources and links them, unless the binary cache holds the
+    // program already. also reflects the active uniforms into the table behind
+    // getUniformLocation
     void link();
 
+    // link() in two halves: beginLink() only submits the work, so the driver's compiler
+    // threads (KHR_parallel_shader_compile) run while the caller does something else.
+    // finishLink() checks the result and throws like link(), it blocks until the link
+    // is done, which isLinkComplete() tells without blocking
+    void beginLink();
+
+    bool isLinkComplete() const;
+
+    void finishLink();
+
+    // submits every program before waiting for any, then finishes them as they complete
+    static void linkAll(const std::vector<GLSLProgram*>& programs);
+
+    // the second half of linkAll() for programs already begun
+    static void finishLinks(const std::vector<GLSLProgram*>& programs);
+
+    static bool isParallelCompileSupported();
+
+    // whether the last link() was served by the binary cache
+    bool isLinkedFromCache() const;
+
+    // programs linked from now on are looked up in and written to directory, keyed by
+    // their sources and the driver. an empty directory turns the cache off, so does a
+    // driver without program binaries (gl 4.1 or ARB_get_program_binary)
+    static void setBinaryCacheDirectory(const std::string& directory);
+
+    static bool isBinaryCacheEnabled();
+
+    // drivers often finish compiling at the first draw with a program, this issues a
+    // throwaway draw with every linked program at load time so the first frames do not
+    // stall. uniform blocks of the programs should have their buffers bound by then
+    static void prewarm();
+
     void use();
 
     void unuse();
 
+    // -1 when the uniform is not active, served from the table built by link()
+    GLint getUniformLocation(const std::string& name) const;
+
+    // resolve once at init, throws when the uniform is declared with another type
+    template <typename T>
+    UniformHandle<T> getUniformHandle(const std::string& name) const;
+
     int getUniformBlockSize(const std::string& name) const;
 
     int getUniformBlockIndex(const std::string& name) const;
@@ -63,16 +183,95 @@ public:
 
     void setUniformBlockBinding(const std::string& name, uint32_t binding) const;
 
+    void setUniform(UniformHandle<bool> handle, bool value) const;
+
+    void setUniform(UniformHandle<int> handle, int value) const;
+
+    void setUniform(UniformHandle<uint32_t> handle, uint32_t value) const;
+
+    void setUniform(UniformHandle<float> handle, float value) const;
+
+    void setUniform(UniformHandle<glm::vec2> handle, const glm::vec2& v2) const;
+
+    void setUniform(UniformHandle<glm::vec3> handle, const glm::vec3& v3) const;
+
+    void setUniform(UniformHandle<glm::vec4> handle, const glm::vec4& v4) const;
+
+    void setUniform(UniformHandle<glm::mat2> handle, const glm::mat2& mat2) const;
+
+    void setUniform(UniformHandle<glm::mat3> handle, const glm::mat3& mat3) const;
+
+    void setUniform(UniformHandle<glm::mat4> handle, const glm::mat4& mat4) const;
+
 private:
+    struct UniformInfo {
+        std::string name;
+        GLint location;
+        GLenum type;
+    };
+
+    struct ShaderSource {
+        GLenum type;
+        std::string code;
+        std::string filePath; // empty for sources given as code
+    };
+
+    // bumped when the layout of a cache file changes
+    static constexpr uint32_t binaryCacheVersion = 1;
+    static constexpr uint64_t maxBinarySize = 64ull << 20;
+
+    static std::string _binaryCacheDirectory;
+
+    // every program alive, for prewarm()
+    static std::unordered_set<const GLSLProgram*> _programs;
+
     GLuint _handle = 0;
 
-    std::vector<GLuint> _vertexShaders;
+    // active uniforms sorted by name, array elements are listed one by one
+    std::vector<UniformInfo> _uniforms;
+
+    // names already reported missing, each is reported once
+    mutable std::unordered_set<std::string> _missingUniforms;
+
+    // compiled by link(), a cache hit skips them
+    std::vector<ShaderSource> _sources;
+
+    std::vector<std::string> _feedbackVaryings;
 
-    std::vector<GLuint> _geometryShaders;
+    GLenum _feedbackBufferMode = 0;
 
-    std::vector<GLuint> _fragmentShaders;
+    // compiled and linking between beginLink() and finishLink()
+    std::vector<GLuint> _shaders;
+
+    std::string _cachePath;
+
+    bool _linkedFromCache = false;
 
     static std::string readFile(const std::string& filePath);
 
     static GLuint createShader(const std::string& code, GLenum shaderType);
-};
\ No newline at end of file
+
+    void submitCompileAndLink(bool retrievable);
+
+    // the shader objects are detached and deleted again once linked
+    void checkCompileAndLink();
+
+    uint64_t computeCacheKey() const;
+
+    bool loadBinary(const std::string& path);
+
+    void storeBinary(const std::string& path) const;
+
+    void reflectUniforms();
+
+    const UniformInfo* findUniform(const std::string& name) const;
+
+    GLint findUniformLocation(const std::string& name) const;
+
+    GLint resolveUniform(const std::string& name, GLenum type) const;
+};
+
+template <typename T>
+UniformHandle<T> GLSLProgram::getUniformHandle(const std::string& name) const {
+    return UniformHandle<T>(resolveUniform(name, UniformType<T>::value));
+}
\ No newline at end of file
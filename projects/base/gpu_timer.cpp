@@ -0,0 +1,58 @@
+#include "gpu_timer.h"
+
+GpuTimer::GpuTimer() {
+    glGenQueries(queryCount, _queries);
+}
+
+GpuTimer::~GpuTimer() {
+    glDeleteQueries(queryCount, _queries);
+}
+
+void GpuTimer::begin() {
+    collect();
+
+    // every query still in flight, this span goes unmeasured
+    if (_pending[_current]) {
+        return;
+    }
+
+    glBeginQuery(GL_TIME_ELAPSED, _queries[_current]);
+    _active = true;
+}
+
+void GpuTimer::end() {
+    if (!_active) {
+        return;
+    }
+
+    glEndQuery(GL_TIME_ELAPSED);
+    _active = false;
+    _pending[_current] = true;
+    _current = (_current + 1) % queryCount;
+}
+
+double GpuTimer::getMilliseconds() const {
+    return _milliseconds;
+}
+
+void GpuTimer::collect() {
+    for (int i = 0; i < queryCount; ++i) {
+        if (!_pending[i]) {
+            continue;
+        }
+
+        GLuint available = 0;
+        glGetQueryObjectuiv(_queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            continue;
+        }
+
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(_queries[i], GL_QUERY_RESULT, &nanoseconds);
+        _pending[i] = false;
+
+        const double milliseconds = static_cast<double>(nanoseconds) * 1e-6;
+        _milliseconds = _milliseconds == 0.0 ? milliseconds
+                                             : 0.9 * _milliseconds + 0.1 * milliseconds;
+    }
+}
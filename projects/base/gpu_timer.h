@@ -0,0 +1,36 @@
+#pragma once
+
+#include "gl_utility.h"
+
+// gpu time spent on the commands between begin() and end(), measured with
+// GL_TIME_ELAPSED queries. results are read from a small ring of queries a few frames
+// later, so reading them never stalls the pipeline. gl allows one active time query
+// at a time, timers must not be nested
+class GpuTimer {
+public:
+    GpuTimer();
+
+    GpuTimer(const GpuTimer&) = delete;
+
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    ~GpuTimer();
+
+    void begin();
+
+    void end();
+
+    // smoothed over the last results, 0 until the first one arrived
+    double getMilliseconds() const;
+
+private:
+    static constexpr int queryCount = 4;
+
+    GLuint _queries[queryCount] = {};
+    bool _pending[queryCount] = {};
+    int _current = 0;
+    bool _active = false;
+    double _milliseconds = 0.0;
+
+    void collect();
+};
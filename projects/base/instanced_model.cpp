@@ -1,65 +1,41 @@
 #include "instanced_model.h"
+#include "gl_state_cache.h"
+#include <algorithm>
 #include <iostream>
 
 InstancedModel::InstancedModel(
     const std::string& filepath, const std::vector<glm::mat4>& modelMatrices)
-    : Model(filepath), _modelMatrices(modelMatrices) {
-    glBindVertexArray(_vao);
+    : InstancedModel(std::make_shared<Model>(filepath), modelMatrices) {}
 
-    glGenBuffers(1, &_instanceVbo);
-    glBindBuffer(GL_ARRAY_BUFFER, _instanceVbo);
-    glBufferData(
-        GL_ARRAY_BUFFER, _modelMatrices.size() * sizeof(glm::mat4), _modelMatrices.data(),
-        GL_STATIC_DRAW);
-
-    constexpr GLsizei stride = sizeof(glm::mat4);
-    constexpr GLsizei unitSize = sizeof(glm::vec4);
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, stride, (void*)(0 * unitSize));
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, stride, (void*)(1 * unitSize));
-    glEnableVertexAttribArray(5);
-    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, stride, (void*)(2 * unitSize));
-    glEnableVertexAttribArray(6);
-    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, stride, (void*)(3 * unitSize));
-
-    glVertexAttribDivisor(3, 1);
-    glVertexAttribDivisor(4, 1);
-    glVertexAttribDivisor(5, 1);
-    glVertexAttribDivisor(6, 1);
-
-    glBindVertexArray(0);
-
-    glBindVertexArray(_boxVao);
-    glBindBuffer(GL_ARRAY_BUFFER, _instanceVbo);
-
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, (void*)(0 * unitSize));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride, (void*)(1 * unitSize));
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, stride, (void*)(2 * unitSize));
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, stride, (void*)(3 * unitSize));
-
-    glVertexAttribDivisor(1, 1);
-    glVertexAttribDivisor(2, 1);
-    glVertexAttribDivisor(3, 1);
-    glVertexAttribDivisor(4, 1);
+InstancedModel::InstancedModel(
+    std::shared_ptr<const Model> mesh, const std::vector<glm::mat4>& modelMatrices)
+    : _mesh(std::move(mesh)), _modelMatrices(modelMatrices),
+      _visibleCount(static_cast<int>(modelMatrices.size())), _usage(GL_STATIC_DRAW) {
+    initGLResources();
+    uploadInstances(_modelMatrices.data(), static_cast<int>(_modelMatrices.size()));
+}
 
-    glBindVertexArray(0);
+InstancedModel::InstancedModel(std::shared_ptr<const Model> mesh)
+    : _mesh(std::move(mesh)), _usage(GL_STREAM_DRAW) {
+    initGLResources();
 }
 
 InstancedModel::InstancedModel(InstancedModel&& rhs) noexcept
-    : Model(std::move(rhs)), _instanceVbo(rhs._instanceVbo) {
+    : _mesh(std::move(rhs._mesh)), _modelMatrices(std::move(rhs._modelMatrices)),
+      _visibleCount(rhs._visibleCount), _vao(rhs._vao), _boxVao(rhs._boxVao),
+      _instanceVbo(rhs._instanceVbo), _normalVbo(rhs._normalVbo),
+      _normalMatrices(std::move(rhs._normalMatrices)), _instanceCapacity(rhs._instanceCapacity),
+      _usage(rhs._usage) {
+    rhs._visibleCount = 0;
+    rhs._vao = 0;
+    rhs._boxVao = 0;
     rhs._instanceVbo = 0;
+    rhs._normalVbo = 0;
+    rhs._instanceCapacity = 0;
 }
 
 InstancedModel::~InstancedModel() {
-    if (_instanceVbo) {
-        glDeleteBuffers(1, &_instanceVbo);
-        _instanceVbo = 0;
-    }
+    cleanup();
 }
 
 int InstancedModel::getInstanceCount() const {
@@ -74,34 +50,179 @@ const std::vector<glm::mat4>& InstancedModel::getModelMatrices() const {
     return _modelMatrices;
 }
 
+void InstancedModel::updateInstances(const std::vector<glm::mat4>& modelMatrices) {
+    updateInstances(modelMatrices.data(), static_cast<int>(modelMatrices.size()));
+}
+
+void InstancedModel::updateInstances(const glm::mat4* modelMatrices, int count) {
+    _modelMatrices.assign(modelMatrices, modelMatrices + count);
+    _visibleCount = count;
+
+    uploadInstances(modelMatrices, count);
+}
+
+void InstancedModel::setVisibleInstanceCount(int count) {
+    _visibleCount = std::min(count, static_cast<int>(_modelMatrices.size()));
+}
+
+int InstancedModel::getVisibleInstanceCount() const {
+    return _visibleCount;
+}
+
+const Model& InstancedModel::getMesh() const {
+    return *_mesh;
+}
+
+GLuint InstancedModel::getVao() const {
+    return _vao;
+}
+
+BoundingBox InstancedModel::getBoundingBox() const {
+    return _mesh->getBoundingBox();
+}
+
 void InstancedModel::draw() const {
-    glBindVertexArray(_vao);
-    glDrawElementsInstanced(
-        GL_TRIANGLES, static_cast<GLsizei>(_indices.size()), GL_UNSIGNED_INT, 0,
-        static_cast<GLsizei>(_modelMatrices.size()));
-    glBindVertexArray(0);
+    draw(_visibleCount);
 }
 
 void InstancedModel::draw(int amount) const {
-    glBindVertexArray(_vao);
+    if (amount <= 0) {
+        return;
+    }
+
+    GLStateCache::instance().bindVertexArray(_vao);
     glDrawElementsInstanced(
-        GL_TRIANGLES, static_cast<GLsizei>(_indices.size()), GL_UNSIGNED_INT, 0, amount);
-    glBindVertexArray(0);
+        GL_TRIANGLES, static_cast<GLsizei>(_mesh->getIndices().size()), GL_UNSIGNED_INT, 0,
+        amount);
 }
 
 void InstancedModel::drawBoundingBox() const {
-    glBindVertexArray(_boxVao);
-    glDrawElementsInstanced(
-        GL_LINES, 24, GL_UNSIGNED_INT, 0, static_cast<GLsizei>(_modelMatrices.size()));
-    glBindVertexArray(0);
+    drawBoundingBox(_visibleCount);
 }
 
 void InstancedModel::drawBoundingBox(int amount) const {
-    glBindVertexArray(_boxVao);
+    if (amount <= 0) {
+        return;
+    }
+
+    GLStateCache::instance().bindVertexArray(_boxVao);
     glDrawElementsInstanced(GL_LINES, 24, GL_UNSIGNED_INT, 0, amount);
-    glBindVertexArray(0);
 }
 
 GLuint InstancedModel::getInstacenVbo() const {
     return _instanceVbo;
-}
\ No newline at end of file
+}
+
+void InstancedModel::initGLResources() {
+    // the vertex and index buffers belong to the shared mesh,
+    // only the vertex array objects and the instance buffer are owned here
+    glGenBuffers(1, &_instanceVbo);
+    glGenBuffers(1, &_normalVbo);
+
+    constexpr GLsizei stride = sizeof(glm::mat4);
+    constexpr size_t unitSize = sizeof(glm::vec4);
+
+    glGenVertexArrays(1, &_vao);
+    GLStateCache::instance().bindVertexArray(_vao);
+
+    GLStateCache::instance().bindBuffer(GL_ARRAY_BUFFER, _mesh->getVbo());
+    GLStateCache::instance().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, _mesh->getEbo());
+    glVertexAttribPointer(
+        0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(
+        1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(
+        2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));
+    glEnableVertexAttribArray(2);
+
+    GLStateCache::instance().bindBuffer(GL_ARRAY_BUFFER, _instanceVbo);
+    for (GLuint i = 0; i < 4; ++i) {
+        const size_t offset = i * unitSize;
+        glEnableVertexAttribArray(3 + i);
+        glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+        glVertexAttribDivisor(3 + i, 1);
+    }
+
+    GLStateCache::instance().bindBuffer(GL_ARRAY_BUFFER, _normalVbo);
+    for (GLuint i = 0; i < 3; ++i) {
+        const size_t offset = i * sizeof(glm::vec3);
+        glEnableVertexAttribArray(7 + i);
+        glVertexAttribPointer(7 + i, 3, GL_FLOAT, GL_FALSE, sizeof(glm::mat3), (void*)offset);
+        glVertexAttribDivisor(7 + i, 1);
+    }
+
+    GLStateCache::instance().bindVertexArray(0);
+
+    glGenVertexArrays(1, &_boxVao);
+    GLStateCache::instance().bindVertexArray(_boxVao);
+
+    GLStateCache::instance().bindBuffer(GL_ARRAY_BUFFER, _mesh->getBoundingBoxVbo());
+    GLStateCache::instance().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, _mesh->getBoundingBoxEbo());
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
+    glEnableVertexAttribArray(0);
+
+    GLStateCache::instance().bindBuffer(GL_ARRAY_BUFFER, _instanceVbo);
+    for (GLuint i = 0; i < 4; ++i) {
+        const size_t offset = i * unitSize;
+        glEnableVertexAttribArray(1 + i);
+        glVertexAttribPointer(1 + i, 4, GL_FLOAT, GL_FALSE, stride, (void*)offset);
+        glVertexAttribDivisor(1 + i, 1);
+    }
+
+    GLStateCache::instance().bindVertexArray(0);
+    GLStateCache::instance().bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstancedModel::uploadInstances(const glm::mat4* modelMatrices, int count) {
+    if (count == 0) {
+        return;
+    }
+
+    // once per instance here instead of an inverse per vertex in the shader
+    _normalMatrices.resize(count);
+    for (int i = 0; i < count; ++i) {
+        _normalMatrices[i] = computeNormalMatrix(modelMatrices[i]);
+    }
+
+    if (static_cast<size_t>(count) > _instanceCapacity) {
+        // grow geometrically so a slowly increasing count does not reallocate every frame
+        _instanceCapacity = std::max(static_cast<size_t>(count), 2 * _instanceCapacity);
+    }
+
+    GLStateCache::instance().bindBuffer(GL_ARRAY_BUFFER, _instanceVbo);
+    glBufferData(GL_ARRAY_BUFFER, _instanceCapacity * sizeof(glm::mat4), nullptr, _usage);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::mat4), modelMatrices);
+
+    GLStateCache::instance().bindBuffer(GL_ARRAY_BUFFER, _normalVbo);
+    glBufferData(GL_ARRAY_BUFFER, _instanceCapacity * sizeof(glm::mat3), nullptr, _usage);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::mat3), _normalMatrices.data());
+    GLStateCache::instance().bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstancedModel::cleanup() {
+    if (_normalVbo != 0) {
+        GLStateCache::instance().forgetBuffer(_normalVbo);
+        glDeleteBuffers(1, &_normalVbo);
+        _normalVbo = 0;
+    }
+
+    if (_instanceVbo != 0) {
+        GLStateCache::instance().forgetBuffer(_instanceVbo);
+        glDeleteBuffers(1, &_instanceVbo);
+        _instanceVbo = 0;
+    }
+
+    if (_boxVao != 0) {
+        GLStateCache::instance().forgetVertexArray(_boxVao);
+        glDeleteVertexArrays(1, &_boxVao);
+        _boxVao = 0;
+    }
+
+    if (_vao != 0) {
+        GLStateCache::instance().forgetVertexArray(_vao);
+        glDeleteVertexArrays(1, &_vao);
+        _vao = 0;
+    }
+}
@@ -1,15 +1,24 @@
 #pragma once
 
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "gl_utility.h"
 #include "model.h"
 
-class InstancedModel : public Model {
+// draws many copies of one mesh with a single call, the per-instance model
+// matrices live in locations 3~6 of the mesh vao and 1~4 of the box vao. the normal
+// matrices, computed on the cpu once per instance, live in locations 7~9 of the mesh vao
+class InstancedModel {
 public:
     InstancedModel(const std::string& filepath, const std::vector<glm::mat4>& modelMatrices);
 
+    InstancedModel(std::shared_ptr<const Model> mesh, const std::vector<glm::mat4>& modelMatrices);
+
+    // dynamic instances, fill with updateInstances every frame
+    InstancedModel(std::shared_ptr<const Model> mesh);
+
     InstancedModel(InstancedModel&& rhs) noexcept;
 
     ~InstancedModel();
@@ -20,17 +29,51 @@ public:
 
     const std::vector<glm::mat4>& getModelMatrices() const;
 
-    void draw() const override;
+    // replace the instance data, the buffer is orphaned before the upload so the
+    // driver never has to wait for draws of last frame still reading the old storage
+    void updateInstances(const std::vector<glm::mat4>& modelMatrices);
+
+    void updateInstances(const glm::mat4* modelMatrices, int count);
+
+    // number of instances drawn by draw() and drawBoundingBox()
+    void setVisibleInstanceCount(int count);
+
+    int getVisibleInstanceCount() const;
+
+    const Model& getMesh() const;
+
+    // mesh vao with the instance attributes attached
+    GLuint getVao() const;
+
+    BoundingBox getBoundingBox() const;
+
+    void draw() const;
 
     void draw(int amount) const;
 
-    void drawBoundingBox() const override;
+    void drawBoundingBox() const;
 
     void drawBoundingBox(int amount) const;
 
     GLuint getInstacenVbo() const;
 
 private:
+    std::shared_ptr<const Model> _mesh;
+
     std::vector<glm::mat4> _modelMatrices;
-    GLuint _instanceVbo = {};
-};
\ No newline at end of file
+    int _visibleCount = 0;
+
+    GLuint _vao = 0;
+    GLuint _boxVao = 0;
+    GLuint _instanceVbo = 0;
+    GLuint _normalVbo = 0;
+    std::vector<glm::mat3> _normalMatrices; // staging for the upload
+    size_t _instanceCapacity = 0;
+    GLenum _usage = GL_STATIC_DRAW;
+
+    void initGLResources();
+
+    void uploadInstances(const glm::mat4* modelMatrices, int count);
+
+    void cleanup();
+};
@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "gl_state_cache.h"
+#include "light_clusters.h"
+
+constexpr int LightClusters::texelsPerLight;
+constexpr float LightClusters::attenuationCutoff;
+constexpr float LightClusters::unboundedRange;
+
+LightClusters::LightClusters(int tilesX, int tilesY, int slices, ThreadPool* threadPool)
+    : _tilesX(tilesX), _tilesY(tilesY), _slices(slices), _threadPool(threadPool),
+      _clusterLights(static_cast<size_t>(tilesX) * tilesY * slices) {
+    auto create = [](GLuint& buffer, GLuint& texture, GLenum format, size_t size) {
+        glGenBuffers(1, &buffer);
+        GLStateCache::instance().bindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+
+        glGenTextures(1, &texture);
+        GLStateCache::instance().bindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+    };
+
+    create(_lightBuffer, _lightTexture, GL_RGBA32F, texelsPerLight * sizeof(glm::vec4));
+    create(_listBuffer, _listTexture, GL_R32UI, 2 * _clusterLights.size() * sizeof(uint32_t));
+}
+
+LightClusters::~LightClusters() {
+    for (GLuint texture : {_lightTexture, _listTexture}) {
+        GLStateCache::instance().forgetTexture(texture);
+        glDeleteTextures(1, &texture);
+    }
+
+    for (GLuint buffer : {_lightBuffer, _listBuffer}) {
+        GLStateCache::instance().forgetBuffer(buffer);
+        glDeleteBuffers(1, &buffer);
+    }
+}
+
+void LightClusters::clear() {
+    _lights.clear();
+}
+
+void LightClusters::addPointLight(const PointLight& light) {
+    // a cosine below -1 puts every direction inside the cone
+    addLight(light, -2.0f, light.kc, light.kl, light.kq, glm::vec3(0.0f));
+}
+
+void LightClusters::addSpotLight(const SpotLight& light) {
+    addLight(
+        light, std::cos(light.angle), light.kc, light.kl, light.kq,
+        glm::normalize(light.transform.getFront()));
+}
+
+size_t LightClusters::getLightCount() const {
+    return _lights.size() / texelsPerLight;
+}
+
+void LightClusters::update(const PerspectiveCamera& camera, float maxDepth) {
+    const auto start = std::chrono::steady_clock::now();
+
+    const float znear = camera.znear;
+    maxDepth = std::max(maxDepth, znear * 2.0f);
+    const float logRange = std::log(maxDepth / znear);
+    _sliceScale = _slices / logRange;
+    _sliceBias = -_slices * std::log(znear) / logRange;
+
+    // bounding spheres in view space, binned against the view space cluster boxes
+    const glm::mat4 view = camera.getViewMatrix();
+    _viewSpheres.clear();
+    for (size_t i = 0; i < _lights.size(); i += texelsPerLight) {
+        const glm::vec4 center = view * glm::vec4(glm::vec3(_lights[i]), 1.0f);
+        _viewSpheres.push_back(glm::vec4(glm::vec3(center), _lights[i].w));
+    }
+
+    const float tanY = std::tan(camera.fovy * 0.5f);
+    const float tanX = tanY * camera.aspect;
+    auto bin = [&](size_t slice) {
+        binSlice(static_cast<int>(slice), znear, maxDepth, tanX, tanY);
+    };
+    if (_threadPool != nullptr) {
+        _threadPool->parallelFor(static_cast<size_t>(_slices), bin);
+    } else {
+        for (int slice = 0; slice < _slices; ++slice) {
+            bin(slice);
+        }
+    }
+
+    // concatenate behind a header of offset and count per cluster
+    const size_t clusterCount = _clusterLights.size();
+    _lists.resize(2 * clusterCount);
+    uint32_t offset = static_cast<uint32_t>(2 * clusterCount);
+    for (size_t i = 0; i < clusterCount; ++i) {
+        _lists[2 * i] = offset;
+        _lists[2 * i + 1] = static_cast<uint32_t>(_clusterLights[i].size());
+        offset += static_cast<uint32_t>(_clusterLights[i].size());
+    }
+    _lists.reserve(offset);
+    for (const auto& lights : _clusterLights) {
+        _lists.insert(_lists.end(), lights.begin(), lights.end());
+    }
+
+    const std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    _binningMilliseconds = elapsed.count();
+
+    upload(_lightBuffer, _lights.data(), _lights.size() * sizeof(glm::vec4));
+    upload(_listBuffer, _lists.data(), _lists.size() * sizeof(uint32_t));
+}
+
+void LightClusters::bind(GLuint lightUnit, GLuint listUnit) const {
+    GLStateCache::instance().bindTexture(lightUnit, GL_TEXTURE_BUFFER, _lightTexture);
+    GLStateCache::instance().bindTexture(listUnit, GL_TEXTURE_BUFFER, _listTexture);
+}
+
+glm::ivec3 LightClusters::getGridSize() const {
+    return glm::ivec3(_tilesX, _tilesY, _slices);
+}
+
+float LightClusters::getSliceScale() const {
+    return _sliceScale;
+}
+
+float LightClusters::getSliceBias() const {
+    return _sliceBias;
+}
+
+size_t LightClusters::getAssignedCount() const {
+    return _lists.size() - std::min(_lists.size(), 2 * _clusterLights.size());
+}
+
+double LightClusters::getBinningMilliseconds() const {
+    return _binningMilliseconds;
+}
+
+float LightClusters::computeRange(float intensity, float kc, float kl, float kq) {
+    // solve kq * d^2 + kl * d + kc = intensity / cutoff for d
+    const float c = kc - intensity / attenuationCutoff;
+    if (c >= 0.0f) {
+        return 0.0f;
+    }
+    if (kq <= 0.0f) {
+        return kl > 0.0f ? -c / kl : unboundedRange;
+    }
+
+    return (-kl + std::sqrt(kl * kl - 4.0f * kq * c)) / (2.0f * kq);
+}
+
+void LightClusters::addLight(
+    const Light& light, float cosAngle, float kc, float kl, float kq,
+    const glm::vec3& direction) {
+    const float range = computeRange(light.intensity, kc, kl, kq);
+    _lights.push_back(glm::vec4(light.transform.position, range));
+    _lights.push_back(glm::vec4(light.color * light.intensity, cosAngle));
+    _lights.push_back(glm::vec4(direction, kc));
+    _lights.push_back(glm::vec4(kl, kq, 0.0f, 0.0f));
+}
+
+void LightClusters::binSlice(int slice, float znear, float maxDepth, float tanX, float tanY) {
+    const size_t tileCount = static_cast<size_t>(_tilesX) * _tilesY;
+    auto clusters = _clusterLights.begin() + slice * tileCount;
+    for (size_t i = 0; i < tileCount; ++i) {
+        clusters[i].clear();
+    }
+
+    const float depthRatio = maxDepth / znear;
+    const float sliceNear = znear * std::pow(depthRatio, static_cast<float>(slice) / _slices);
+    const float sliceFar = znear * std::pow(depthRatio, static_cast<float>(slice + 1) / _slices);
+
+    auto toTile = [](float ndc, int tiles) {
+        return std::min(std::max(static_cast<int>((ndc * 0.5f + 0.5f) * tiles), 0), tiles - 1);
+    };
+
+    for (size_t light = 0; light < _viewSpheres.size(); ++light) {
+        const glm::vec4& sphere = _viewSpheres[light];
+        const float depth = -sphere.z;
+        const float range = sphere.w;
+        if (depth + range < sliceNear || depth - range > sliceFar) {
+            continue;
+        }
+
+        // the part of the sphere inside the slice projects between the extremes of its
+        // box corners, x / (depth * tan) is monotonic in both along every edge
+        const float nearest = std::max(sliceNear, depth - range);
+        const float farthest = std::min(sliceFar, depth + range);
+        const float minX = std::min(
+            (sphere.x - range) / (nearest * tanX), (sphere.x - range) / (farthest * tanX));
+        const float maxX = std::max(
+            (sphere.x + range) / (nearest * tanX), (sphere.x + range) / (farthest * tanX));
+        const float minY = std::min(
+            (sphere.y - range) / (nearest * tanY), (sphere.y - range) / (farthest * tanY));
+        const float maxY = std::max(
+            (sphere.y + range) / (nearest * tanY), (sphere.y + range) / (farthest * tanY));
+        if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f) {
+            continue;
+        }
+
+        const int firstX = toTile(minX, _tilesX), lastX = toTile(maxX, _tilesX);
+        const int firstY = toTile(minY, _tilesY), lastY = toTile(maxY, _tilesY);
+        for (int y = firstY; y <= lastY; ++y) {
+            const float bottom = -1.0f + 2.0f * y / _tilesY;
+            const float top = -1.0f + 2.0f * (y + 1) / _tilesY;
+            for (int x = firstX; x <= lastX; ++x) {
+                const float left = -1.0f + 2.0f * x / _tilesX;
+                const float right = -1.0f + 2.0f * (x + 1) / _tilesX;
+
+                // view space box of the cluster against the sphere
+                glm::vec3 boxMin, boxMax;
+                boxMin.x = std::min(left * sliceNear, left * sliceFar) * tanX;
+                boxMax.x = std::max(right * sliceNear, right * sliceFar) * tanX;
+                boxMin.y = std::min(bottom * sliceNear, bottom * sliceFar) * tanY;
+                boxMax.y = std::max(top * sliceNear, top * sliceFar) * tanY;
+                boxMin.z = -sliceFar;
+                boxMax.z = -sliceNear;
+
+                const glm::vec3 center(sphere);
+                const glm::vec3 offset = glm::clamp(center, boxMin, boxMax) - center;
+                if (glm::dot(offset, offset) <= range * range) {
+                    clusters[x + y * _tilesX].push_back(static_cast<uint32_t>(light));
+                }
+            }
+        }
+    }
+}
+
+void LightClusters::upload(GLuint buffer, const void* data, size_t size) {
+    if (size == 0) {
+        return;
+    }
+
+    // respecified every frame, the driver renames the storage instead of waiting for the
+    // frame still reading it
+    GLStateCache::instance().bindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "camera.h"
+#include "gl_utility.h"
+#include "light.h"
+#include "thread_pool.h"
+
+// clustered forward lighting. the view frustum is split into tilesX x tilesY screen tiles
+// and slices exponential in depth, each cluster lists the point and spot lights whose
+// range reaches into it. a fragment finds its cluster from gl_FragCoord and its view
+// depth and loops over that list only, so its cost follows the lights nearby instead of
+// every light of the scene.
+//
+// both buffers are read as samplerBuffer/usamplerBuffer:
+// - lights, rgba32f, texelsPerLight texels per light in world space:
+//   (position, range), (color * intensity, cos of the spot angle or -2 for a point
+//   light), (direction, kc), (kl, kq, 0, 0)
+// - lists, r32ui, two texels per cluster x + tilesX * (y + tilesY * slice) giving the
+//   offset and the count of its light indices, which follow after the last cluster
+class LightClusters {
+public:
+    static constexpr int texelsPerLight = 4;
+
+    // contributions below this fraction of the intensity are cut off, it bounds the range
+    static constexpr float attenuationCutoff = 0.02f;
+
+    // range of a light that never drops below the cutoff, finite so it still projects
+    static constexpr float unboundedRange = 1e6f;
+
+    LightClusters(int tilesX, int tilesY, int slices, ThreadPool* threadPool = nullptr);
+
+    LightClusters(const LightClusters&) = delete;
+
+    LightClusters& operator=(const LightClusters&) = delete;
+
+    ~LightClusters();
+
+    // the lights stay until cleared
+    void clear();
+
+    void addPointLight(const PointLight& light);
+
+    void addSpotLight(const SpotLight& light);
+
+    size_t getLightCount() const;
+
+    // bins the lights into the clusters of the camera between its near plane and maxDepth,
+    // slices run in parallel on the pool. then uploads the lights and the lists
+    void update(const PerspectiveCamera& camera, float maxDepth);
+
+    // the light buffer and the lists as buffer textures on the two units
+    void bind(GLuint lightUnit, GLuint listUnit) const;
+
+    glm::ivec3 getGridSize() const;
+
+    // the slice of a view depth is floor(log(depth) * scale + bias)
+    float getSliceScale() const;
+
+    float getSliceBias() const;
+
+    // light indices in all lists after the last update
+    size_t getAssignedCount() const;
+
+    // cpu time of the binning in the last update
+    double getBinningMilliseconds() const;
+
+    // distance at which the attenuation drops below attenuationCutoff
+    static float computeRange(float intensity, float kc, float kl, float kq);
+
+private:
+    int _tilesX;
+    int _tilesY;
+    int _slices;
+    ThreadPool* _threadPool;
+
+    float _sliceScale = 0.0f;
+    float _sliceBias = 0.0f;
+
+    std::vector<glm::vec4> _lights; // packed as uploaded
+    std::vector<glm::vec4> _viewSpheres; // view space center and range of every light
+
+    std::vector<std::vector<uint32_t>> _clusterLights; // light indices of every cluster
+    std::vector<uint32_t> _lists; // header and indices as uploaded
+
+    double _binningMilliseconds = 0.0;
+
+    GLuint _lightBuffer = 0;
+    GLuint _lightTexture = 0;
+    GLuint _listBuffer = 0;
+    GLuint _listTexture = 0;
+
+    void addLight(
+        const Light& light, float cosAngle, float kc, float kl, float kq,
+        const glm::vec3& direction);
+
+    // fills the lists of the clusters in one slice, touches nothing else
+    void binSlice(int slice, float znear, float maxDepth, float tanX, float tanY);
+
+    static void upload(GLuint buffer, const void* data, size_t size);
+};
@@ -0,0 +1,42 @@
+#include "mesh_library.h"
+
+std::shared_ptr<const Model> MeshLibrary::acquire(
+    const std::string& key, const Builder& builder) {
+    auto iter = _meshes.find(key);
+    if (iter != _meshes.end()) {
+        return iter->second;
+    }
+
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    builder(vertices, indices);
+
+    std::shared_ptr<const Model> mesh = std::make_shared<Model>(vertices, indices);
+    _meshes[key] = mesh;
+
+    return mesh;
+}
+
+std::shared_ptr<const Model> MeshLibrary::find(const std::string& key) const {
+    auto iter = _meshes.find(key);
+    if (iter == _meshes.end()) {
+        return nullptr;
+    }
+
+    return iter->second;
+}
+
+size_t MeshLibrary::getMeshCount() const {
+    return _meshes.size();
+}
+
+void MeshLibrary::forEach(
+    const std::function<void(const std::string&, const Model&)>& visit) const {
+    for (const auto& entry : _meshes) {
+        visit(entry.first, *entry.second);
+    }
+}
+
+void MeshLibrary::clear() {
+    _meshes.clear();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "model.h"
+#include "vertex.h"
+
+// flyweight storage for immutable meshes: every key is generated and uploaded
+// to the gpu once, and all users share the same vertex/index buffers
+class MeshLibrary {
+public:
+    using Builder = std::function<void(std::vector<Vertex>&, std::vector<uint32_t>&)>;
+
+    MeshLibrary() = default;
+
+    MeshLibrary(const MeshLibrary&) = delete;
+
+    MeshLibrary& operator=(const MeshLibrary&) = delete;
+
+    ~MeshLibrary() = default;
+
+    // return the mesh registered under key, build it with builder on the first request
+    std::shared_ptr<const Model> acquire(const std::string& key, const Builder& builder);
+
+    std::shared_ptr<const Model> find(const std::string& key) const;
+
+    size_t getMeshCount() const;
+
+    void forEach(const std::function<void(const std::string&, const Model&)>& visit) const;
+
+    void clear();
+
+private:
+    std::unordered_map<std::string, std::shared_ptr<const Model>> _meshes;
+};
@@ -0,0 +1,282 @@
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+#include "mesh_optimizer.h"
+
+namespace {
+constexpr uint32_t invalidIndex = std::numeric_limits<uint32_t>::max();
+
+// fifo cache simulated with the time every vertex entered it, a vertex is still cached
+// while fewer than cacheSize others entered after it
+class CacheSimulator {
+public:
+    explicit CacheSimulator(size_t vertexCount) : _timestamps(vertexCount, 0) {}
+
+    // 0 to 3 misses of a triangle
+    int addTriangle(const uint32_t* corners) {
+        int misses = 0;
+        for (int k = 0; k < 3; ++k) {
+            if (_time - _timestamps[corners[k]] > MeshOptimizer::cacheSize) {
+                _timestamps[corners[k]] = _time++;
+                ++misses;
+            }
+        }
+        return misses;
+    }
+
+    void flush() {
+        _time += MeshOptimizer::cacheSize + 1;
+    }
+
+private:
+    std::vector<uint32_t> _timestamps;
+    uint32_t _time = MeshOptimizer::cacheSize + 1;
+};
+} // namespace
+
+namespace MeshOptimizer {
+CacheStatistics analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount) {
+    CacheStatistics statistics;
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return statistics;
+    }
+
+    CacheSimulator cache(vertexCount);
+    size_t misses = 0;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        misses += cache.addTriangle(&indices[3 * t]);
+    }
+
+    std::vector<bool> used(vertexCount, false);
+    size_t usedCount = 0;
+    for (uint32_t index : indices) {
+        if (!used[index]) {
+            used[index] = true;
+            ++usedCount;
+        }
+    }
+
+    statistics.acmr = static_cast<float>(misses) / triangleCount;
+    statistics.atvr = static_cast<float>(misses) / usedCount;
+
+    return statistics;
+}
+
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount) {
+    const size_t triangleCount = indices.size() / 3;
+
+    // triangles around every vertex in compressed rows, and how many are not emitted yet
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (uint32_t index : indices) {
+        ++offsets[index + 1];
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (uint32_t t = 0; t < triangleCount; ++t) {
+        for (int k = 0; k < 3; ++k) {
+            adjacency[fill[indices[3 * t + k]]++] = t;
+        }
+    }
+    std::vector<uint32_t> live(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        live[v] = offsets[v + 1] - offsets[v];
+    }
+
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnds; // recently used vertices, to resume from at a dead end
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    size_t cursor = 0;
+
+    uint32_t fan = vertexCount > 0 ? 0 : invalidIndex;
+    while (fan != invalidIndex) {
+        candidates.clear();
+        for (uint32_t a = offsets[fan]; a < offsets[fan + 1]; ++a) {
+            const uint32_t t = adjacency[a];
+            if (emitted[t]) {
+                continue;
+            }
+            emitted[t] = true;
+            for (int k = 0; k < 3; ++k) {
+                const uint32_t v = indices[3 * t + k];
+                result.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (time - timestamps[v] > cacheSize) {
+                    timestamps[v] = time++;
+                }
+            }
+        }
+
+        // the next fan is the oldest candidate that stays cached while its remaining
+        // triangles are emitted, or any candidate with triangles left
+        fan = invalidIndex;
+        int bestPriority = -1;
+        for (uint32_t v : candidates) {
+            if (live[v] == 0) {
+                continue;
+            }
+            int priority = 0;
+            if (time - timestamps[v] + 2 * live[v] <= cacheSize) {
+                priority = static_cast<int>(time - timestamps[v]);
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                fan = v;
+            }
+        }
+
+        // dead end: back to a recent vertex with triangles left, else the next in order
+        while (fan == invalidIndex && !deadEnds.empty()) {
+            if (live[deadEnds.back()] > 0) {
+                fan = deadEnds.back();
+            }
+            deadEnds.pop_back();
+        }
+        while (fan == invalidIndex && cursor < vertexCount) {
+            if (live[cursor] > 0) {
+                fan = static_cast<uint32_t>(cursor);
+            }
+            ++cursor;
+        }
+    }
+
+    indices.swap(result);
+}
+
+void optimizeOverdraw(
+    std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, float threshold) {
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // patches: a triangle missing the cache with all three vertices starts a new one
+    CacheSimulator cache(vertices.size());
+    std::vector<size_t> patches;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        if (cache.addTriangle(&indices[3 * t]) == 3 || t == 0) {
+            patches.push_back(t);
+        }
+    }
+    patches.push_back(triangleCount);
+
+    // clusters: inside a patch, a cluster ends once its own acmr is within threshold of
+    // the patch's, so starting the next one with a cold cache costs little
+    std::vector<size_t> clusters;
+    for (size_t p = 0; p + 1 < patches.size(); ++p) {
+        const size_t start = patches[p];
+        const size_t end = patches[p + 1];
+        cache.flush();
+        size_t patchMisses = 0;
+        for (size_t t = start; t < end; ++t) {
+            patchMisses += cache.addTriangle(&indices[3 * t]);
+        }
+        const float limit = threshold * patchMisses / (end - start);
+
+        cache.flush();
+        clusters.push_back(start);
+        size_t misses = 0;
+        size_t count = 0;
+        for (size_t t = start; t < end; ++t) {
+            misses += cache.addTriangle(&indices[3 * t]);
+            ++count;
+            if (t + 1 < end && misses <= limit * count) {
+                clusters.push_back(t + 1);
+                cache.flush();
+                misses = 0;
+                count = 0;
+            }
+        }
+    }
+    clusters.push_back(triangleCount);
+
+    // area weighted centroids and normals of the mesh and of every cluster
+    auto triangleNormal = [&](size_t t) {
+        const glm::vec3& p0 = vertices[indices[3 * t]].position;
+        return glm::cross(
+            vertices[indices[3 * t + 1]].position - p0, vertices[indices[3 * t + 2]].position - p0);
+    };
+    auto triangleCentroid = [&](size_t t) {
+        return (vertices[indices[3 * t]].position + vertices[indices[3 * t + 1]].position
+                + vertices[indices[3 * t + 2]].position)
+               / 3.0f;
+    };
+
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        const float area = glm::length(triangleNormal(t));
+        meshCentroid += area * triangleCentroid(t);
+        meshArea += area;
+    }
+    if (meshArea > 0.0f) {
+        meshCentroid /= meshArea;
+    }
+
+    const size_t clusterCount = clusters.size() - 1;
+    std::vector<float> facing(clusterCount, 0.0f);
+    for (size_t c = 0; c < clusterCount; ++c) {
+        glm::vec3 normal(0.0f);
+        glm::vec3 centroid(0.0f);
+        float area = 0.0f;
+        for (size_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+            const glm::vec3 n = triangleNormal(t);
+            const float a = glm::length(n);
+            normal += n;
+            centroid += a * triangleCentroid(t);
+            area += a;
+        }
+        const float length = glm::length(normal);
+        if (area > 0.0f && length > 0.0f) {
+            facing[c] = glm::dot(centroid / area - meshCentroid, normal / length);
+        }
+    }
+
+    std::vector<size_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&facing](size_t lhs, size_t rhs) {
+        return facing[lhs] > facing[rhs];
+    });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for (size_t c : order) {
+        result.insert(
+            result.end(), indices.begin() + 3 * clusters[c], indices.begin() + 3 * clusters[c + 1]);
+    }
+    indices.swap(result);
+}
+
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+    std::vector<uint32_t> remap(vertices.size(), invalidIndex);
+    std::vector<Vertex> result;
+    result.reserve(vertices.size());
+    for (uint32_t& index : indices) {
+        if (remap[index] == invalidIndex) {
+            remap[index] = static_cast<uint32_t>(result.size());
+            result.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(result);
+}
+
+Report optimize(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+    Report report;
+    report.before = analyzeVertexCache(indices, vertices.size());
+    optimizeVertexCache(indices, vertices.size());
+    optimizeOverdraw(indices, vertices);
+    optimizeVertexFetch(vertices, indices);
+    report.after = analyzeVertexCache(indices, vertices.size());
+
+    return report;
+}
+} // namespace MeshOptimizer
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "vertex.h"
+
+// reorders meshes for the gpu without changing what they look like:
+// - vertex cache: triangles are emitted in fans around recently used vertices (tipsify,
+//   sander et al. 2007), so a post-transform cache reuses most shaded vertices
+// - overdraw: the cache friendly order is cut into clusters where little reuse is lost,
+//   and clusters facing away from the centre of the mesh are drawn first, as they tend
+//   to cover the others
+// - vertex fetch: vertices are stored in the order they are first used, unused ones
+//   are dropped
+namespace MeshOptimizer {
+// fifo post-transform cache size the orders are tuned for and measured with
+constexpr uint32_t cacheSize = 16;
+
+struct CacheStatistics {
+    float acmr = 0.0f; // vertex shader runs per triangle, 3 at worst and about 0.5 at best
+    float atvr = 0.0f; // vertex shader runs per referenced vertex, 1 at best
+};
+
+struct Report {
+    CacheStatistics before;
+    CacheStatistics after;
+};
+
+CacheStatistics analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount);
+
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+
+// expects indices in vertex cache order. threshold is the acmr a cluster may lose against
+// the patch it is cut from, e.g. 1.05 for 5%
+void optimizeOverdraw(
+    std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, float threshold = 1.05f);
+
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+// all three passes in order
+Report optimize(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+} // namespace MeshOptimizer
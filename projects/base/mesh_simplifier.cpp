@@ -0,0 +1,492 @@
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "bounding_box.h"
+#include "mesh_simplifier.h"
+
+namespace {
+// a normal or texture coordinate difference of 1 costs like moving by this fraction of
+// the mesh extent
+constexpr double attributeWeight = 0.01;
+
+// planes through border edges weigh this much per squared edge length
+constexpr double borderWeight = 10.0;
+
+constexpr uint32_t invalidIndex = std::numeric_limits<uint32_t>::max();
+
+uint64_t makeEdgeKey(uint32_t from, uint32_t to) {
+    return (static_cast<uint64_t>(from) << 32) | to;
+}
+
+struct Candidate {
+    float cost;
+    uint32_t from;
+    uint32_t to;
+
+    bool operator>(const Candidate& rhs) const {
+        return cost > rhs.cost;
+    }
+};
+} // namespace
+
+struct MeshSimplifier::State {
+    std::vector<uint32_t> indices;
+    std::vector<bool> dead; // per triangle
+    std::vector<bool> removed; // per vertex
+    std::vector<Quadric> quadrics;
+    std::vector<std::vector<uint32_t>> triangles; // around every vertex, dead ones included
+    size_t liveIndices = 0;
+    float maxCost = 0.0f;
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> heap;
+};
+
+MeshSimplifier::Quadric& MeshSimplifier::Quadric::operator+=(const Quadric& rhs) {
+    a00 += rhs.a00, a01 += rhs.a01, a02 += rhs.a02, a03 += rhs.a03;
+    a11 += rhs.a11, a12 += rhs.a12, a13 += rhs.a13;
+    a22 += rhs.a22, a23 += rhs.a23;
+    a33 += rhs.a33;
+    weight += rhs.weight;
+
+    return *this;
+}
+
+MeshSimplifier::Quadric MeshSimplifier::Quadric::fromPlane(
+    const glm::dvec3& n, double d, double weight) {
+    Quadric q;
+    q.a00 = weight * n.x * n.x, q.a01 = weight * n.x * n.y, q.a02 = weight * n.x * n.z;
+    q.a03 = weight * n.x * d;
+    q.a11 = weight * n.y * n.y, q.a12 = weight * n.y * n.z, q.a13 = weight * n.y * d;
+    q.a22 = weight * n.z * n.z, q.a23 = weight * n.z * d;
+    q.a33 = weight * d * d;
+    q.weight = weight;
+
+    return q;
+}
+
+double MeshSimplifier::Quadric::evaluate(const glm::vec3& p) const {
+    if (weight <= 0.0) {
+        return 0.0;
+    }
+
+    const double x = p.x, y = p.y, z = p.z;
+    const double error = a00 * x * x + a11 * y * y + a22 * z * z
+                         + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+                         + 2.0 * (a03 * x + a13 * y + a23 * z) + a33;
+
+    return std::max(error / weight, 0.0);
+}
+
+MeshSimplifier::MeshSimplifier(
+    const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+    : _vertices(vertices) {
+    BoundingBox box;
+    for (const Vertex& vertex : vertices) {
+        box.min = glm::min(box.min, vertex.position);
+        box.max = glm::max(box.max, vertex.position);
+    }
+    _extent = vertices.empty() ? 0.0f : glm::length(box.max - box.min);
+
+    _group.resize(vertices.size());
+    _nextWedge.resize(vertices.size());
+    std::unordered_map<glm::vec3, uint32_t> firstAt;
+    for (uint32_t v = 0; v < vertices.size(); ++v) {
+        const uint32_t first = firstAt.emplace(vertices[v].position, v).first->second;
+        _group[v] = first;
+        _nextWedge[v] = v;
+        if (first != v) {
+            _nextWedge[v] = _nextWedge[first];
+            _nextWedge[first] = v;
+        }
+    }
+
+    // triangles collapsed to a line or a point already have nothing to keep
+    _indices.reserve(indices.size());
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const uint32_t a = _group[indices[i]];
+        const uint32_t b = _group[indices[i + 1]];
+        const uint32_t c = _group[indices[i + 2]];
+        if (a != b && b != c && c != a) {
+            _indices.insert(_indices.end(), {indices[i], indices[i + 1], indices[i + 2]});
+        }
+    }
+
+    classify();
+}
+
+float MeshSimplifier::getExtent() const {
+    return _extent;
+}
+
+void MeshSimplifier::classify() {
+    const size_t vertexCount = _vertices.size();
+
+    std::unordered_map<uint64_t, int> positionEdges;
+    std::unordered_set<uint64_t> wedgeEdges;
+    for (size_t i = 0; i < _indices.size(); i += 3) {
+        for (int k = 0; k < 3; ++k) {
+            const uint32_t a = _indices[i + k];
+            const uint32_t b = _indices[i + (k + 1) % 3];
+            ++positionEdges[makeEdgeKey(_group[a], _group[b])];
+            wedgeEdges.insert(makeEdgeKey(a, b));
+        }
+    }
+
+    _quadrics.assign(vertexCount, Quadric());
+    std::vector<int> positionOpen(vertexCount, 0); // per group
+    std::vector<int> wedgeOpen(vertexCount, 0); // per vertex
+    std::vector<bool> nonManifold(vertexCount, false); // per group
+    for (size_t i = 0; i < _indices.size(); i += 3) {
+        const glm::dvec3 p0 = _vertices[_indices[i]].position;
+        const glm::dvec3 p1 = _vertices[_indices[i + 1]].position;
+        const glm::dvec3 p2 = _vertices[_indices[i + 2]].position;
+        glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+        const double length = glm::length(normal);
+        if (length > 0.0) {
+            normal /= length;
+            const Quadric plane = Quadric::fromPlane(normal, -glm::dot(normal, p0), 0.5 * length);
+            for (int k = 0; k < 3; ++k) {
+                _quadrics[_group[_indices[i + k]]] += plane;
+            }
+        }
+
+        for (int k = 0; k < 3; ++k) {
+            const uint32_t a = _indices[i + k];
+            const uint32_t b = _indices[i + (k + 1) % 3];
+            const uint32_t ga = _group[a];
+            const uint32_t gb = _group[b];
+            if (positionEdges[makeEdgeKey(ga, gb)] > 1) {
+                // an edge used twice in the same direction joins more than two triangles
+                nonManifold[ga] = nonManifold[gb] = true;
+            }
+
+            if (positionEdges.count(makeEdgeKey(gb, ga)) == 0) {
+                ++positionOpen[ga];
+                ++positionOpen[gb];
+                // a plane through the edge, upright on the triangle, holds the border
+                const glm::dvec3 pa = _vertices[a].position;
+                const glm::dvec3 edge = glm::dvec3(_vertices[b].position) - pa;
+                const glm::dvec3 side = glm::cross(edge, normal);
+                const double sideLength = glm::length(side);
+                if (sideLength > 0.0) {
+                    const Quadric border = Quadric::fromPlane(
+                        side / sideLength, -glm::dot(side / sideLength, pa),
+                        borderWeight * glm::dot(edge, edge));
+                    _quadrics[ga] += border;
+                    _quadrics[gb] += border;
+                }
+            } else if (wedgeEdges.count(makeEdgeKey(b, a)) == 0) {
+                ++wedgeOpen[a];
+                ++wedgeOpen[b];
+            }
+        }
+    }
+
+    _kinds.assign(vertexCount, Kind::Locked);
+    for (uint32_t v = 0; v < vertexCount; ++v) {
+        if (_group[v] != v || nonManifold[v]) {
+            continue;
+        }
+
+        const uint32_t partner = _nextWedge[v];
+        if (partner == v) {
+            if (wedgeOpen[v] == 0 && positionOpen[v] == 0) {
+                _kinds[v] = Kind::Manifold;
+            } else if (wedgeOpen[v] == 0 && positionOpen[v] == 2) {
+                _kinds[v] = Kind::Border;
+            }
+        } else if (_nextWedge[partner] == v) {
+            // two wedges on one seam line, each side with one edge in and one out
+            if (positionOpen[v] == 0 && wedgeOpen[v] == 2 && wedgeOpen[partner] == 2) {
+                _kinds[v] = Kind::Seam;
+            }
+        }
+    }
+}
+
+std::vector<MeshSimplifier::Level> MeshSimplifier::simplify(
+    const std::vector<size_t>& targetIndexCounts, float maxError) const {
+    State state;
+    state.indices = _indices;
+    state.dead.assign(_indices.size() / 3, false);
+    state.removed.assign(_vertices.size(), false);
+    state.quadrics = _quadrics;
+    state.triangles.resize(_vertices.size());
+    for (uint32_t t = 0; t < state.dead.size(); ++t) {
+        for (int k = 0; k < 3; ++k) {
+            state.triangles[_indices[3 * t + k]].push_back(t);
+        }
+    }
+    state.liveIndices = _indices.size();
+
+    for (size_t i = 0; i < _indices.size(); i += 3) {
+        for (int k = 0; k < 3; ++k) {
+            const uint32_t a = _indices[i + k];
+            const uint32_t b = _indices[i + (k + 1) % 3];
+            Collapse collapse;
+            if (plan(state, a, b, collapse)) {
+                state.heap.push({collapse.cost, a, b});
+            }
+            if (plan(state, b, a, collapse)) {
+                state.heap.push({collapse.cost, b, a});
+            }
+        }
+    }
+
+    std::vector<Level> levels;
+    const float maxCost = maxError * maxError;
+    bool exhausted = false;
+    for (size_t targetIndexCount : targetIndexCounts) {
+        while (state.liveIndices > targetIndexCount && !state.heap.empty()) {
+            const Candidate candidate = state.heap.top();
+            state.heap.pop();
+
+            Collapse collapse;
+            if (!plan(state, candidate.from, candidate.to, collapse)) {
+                continue;
+            }
+
+            // costs only grow as quadrics merge, a stale entry goes back with its current one
+            if (collapse.cost > candidate.cost * 1.0001f + std::numeric_limits<float>::min()) {
+                state.heap.push({collapse.cost, candidate.from, candidate.to});
+                continue;
+            }
+
+            if (collapse.cost > maxCost) {
+                exhausted = true;
+                break;
+            }
+
+            // checked last, it is the most expensive test and most entries are stale
+            if (!preservesSurface(state, collapse)) {
+                continue;
+            }
+
+            apply(state, collapse);
+            for (int i = 0; i < collapse.count; ++i) {
+                pushCandidates(state, collapse.to[i]);
+            }
+        }
+
+        // a level that removed nothing since the previous one is not worth keeping
+        const size_t previousCount =
+            levels.empty() ? _indices.size() : levels.back().indices.size();
+        if (state.liveIndices < previousCount) {
+            Level level;
+            level.indices.reserve(state.liveIndices);
+            for (size_t t = 0; t < state.dead.size(); ++t) {
+                if (!state.dead[t]) {
+                    level.indices.insert(
+                        level.indices.end(), state.indices.begin() + 3 * t,
+                        state.indices.begin() + 3 * t + 3);
+                }
+            }
+            level.error = std::sqrt(state.maxCost);
+            levels.push_back(std::move(level));
+        }
+
+        if (exhausted || state.heap.empty()) {
+            break;
+        }
+    }
+
+    return levels;
+}
+
+bool MeshSimplifier::plan(
+    const State& state, uint32_t from, uint32_t to, Collapse& collapse) const {
+    const uint32_t fromGroup = _group[from];
+    const uint32_t toGroup = _group[to];
+    const Kind kind = _kinds[fromGroup];
+    if (state.removed[from] || state.removed[to] || kind == Kind::Locked
+        || fromGroup == toGroup) {
+        return false;
+    }
+
+    collapse.from[0] = from;
+    collapse.to[0] = to;
+    collapse.count = 1;
+    if (kind == Kind::Seam) {
+        // the other side of the seam follows onto the wedge of the target on its side
+        const uint32_t partner = _nextWedge[from];
+        uint32_t partnerTo = invalidIndex;
+        for (uint32_t t : state.triangles[partner]) {
+            if (!state.dead[t] && findWedge(state, t, toGroup) != invalidIndex) {
+                partnerTo = findWedge(state, t, toGroup);
+                break;
+            }
+        }
+        if (partnerTo == invalidIndex) {
+            return false;
+        }
+        collapse.from[1] = partner;
+        collapse.to[1] = partnerTo;
+        collapse.count = 2;
+    }
+
+    // an interior edge has two triangles, a border edge one, a seam edge one per side
+    int shared = 0;
+    for (int i = 0; i < collapse.count; ++i) {
+        int sideShared = 0;
+        for (uint32_t t : state.triangles[collapse.from[i]]) {
+            if (state.dead[t]) {
+                continue;
+            }
+            const uint32_t wedge = findWedge(state, t, toGroup);
+            if (wedge == invalidIndex) {
+                continue;
+            }
+            if (wedge != collapse.to[i]) {
+                return false; // the edge crosses a seam the collapse does not follow
+            }
+            ++sideShared;
+        }
+        if (kind == Kind::Seam && sideShared != 1) {
+            return false;
+        }
+        shared += sideShared;
+    }
+    if (shared != (kind == Kind::Border ? 1 : 2)) {
+        return false;
+    }
+
+    Quadric quadric = state.quadrics[fromGroup];
+    quadric += state.quadrics[toGroup];
+    const glm::vec3 target = _vertices[to].position;
+    double cost = quadric.evaluate(target);
+    const double attributeScale = attributeWeight * attributeWeight * _extent * _extent;
+    for (int i = 0; i < collapse.count; ++i) {
+        const Vertex& a = _vertices[collapse.from[i]];
+        const Vertex& b = _vertices[collapse.to[i]];
+        const glm::vec3 normal = a.normal - b.normal;
+        const glm::vec2 texCoord = a.texCoord - b.texCoord;
+        cost += attributeScale * (glm::dot(normal, normal) + glm::dot(texCoord, texCoord));
+    }
+    collapse.cost = static_cast<float>(cost);
+
+    return true;
+}
+
+bool MeshSimplifier::preservesSurface(const State& state, const Collapse& collapse) const {
+    const uint32_t fromGroup = _group[collapse.from[0]];
+    const uint32_t toGroup = _group[collapse.to[0]];
+    const size_t shared = _kinds[fromGroup] == Kind::Border ? 1 : 2;
+
+    // link condition: the ends may only have the vertices opposite the edge in common,
+    // otherwise the collapse pinches the surface
+    auto collectNeighbours = [&](uint32_t group, std::vector<uint32_t>& neighbours) {
+        uint32_t wedge = group;
+        do {
+            for (uint32_t t : state.triangles[wedge]) {
+                if (state.dead[t]) {
+                    continue;
+                }
+                for (int k = 0; k < 3; ++k) {
+                    const uint32_t neighbour = _group[state.indices[3 * t + k]];
+                    if (neighbour != group) {
+                        neighbours.push_back(neighbour);
+                    }
+                }
+            }
+            wedge = _nextWedge[wedge];
+        } while (wedge != group);
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+    };
+    std::vector<uint32_t> fromNeighbours, toNeighbours, common;
+    collectNeighbours(fromGroup, fromNeighbours);
+    collectNeighbours(toGroup, toNeighbours);
+    std::set_intersection(
+        fromNeighbours.begin(), fromNeighbours.end(), toNeighbours.begin(), toNeighbours.end(),
+        std::back_inserter(common));
+    if (common.size() != shared) {
+        return false;
+    }
+
+    // no triangle that stays may turn over
+    const glm::vec3 target = _vertices[collapse.to[0]].position;
+    for (int i = 0; i < collapse.count; ++i) {
+        for (uint32_t t : state.triangles[collapse.from[i]]) {
+            if (state.dead[t] || findWedge(state, t, toGroup) != invalidIndex) {
+                continue;
+            }
+            glm::vec3 before[3], after[3];
+            for (int k = 0; k < 3; ++k) {
+                const uint32_t v = state.indices[3 * t + k];
+                before[k] = _vertices[v].position;
+                after[k] = v == collapse.from[i] ? target : before[k];
+            }
+            const glm::vec3 normalBefore =
+                glm::cross(before[1] - before[0], before[2] - before[0]);
+            const glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+            if (glm::dot(normalBefore, normalAfter) <= 0.0f) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+uint32_t MeshSimplifier::findWedge(const State& state, uint32_t triangle, uint32_t group) const {
+    for (int k = 0; k < 3; ++k) {
+        const uint32_t vertex = state.indices[3 * triangle + k];
+        if (_group[vertex] == group) {
+            return vertex;
+        }
+    }
+
+    return invalidIndex;
+}
+
+void MeshSimplifier::apply(State& state, const Collapse& collapse) const {
+    for (int i = 0; i < collapse.count; ++i) {
+        const uint32_t from = collapse.from[i];
+        const uint32_t to = collapse.to[i];
+        for (uint32_t t : state.triangles[from]) {
+            if (state.dead[t]) {
+                continue;
+            }
+
+            uint32_t* corners = &state.indices[3 * t];
+            if (corners[0] == to || corners[1] == to || corners[2] == to) {
+                state.dead[t] = true;
+                state.liveIndices -= 3;
+            } else {
+                std::replace(corners, corners + 3, from, to);
+                state.triangles[to].push_back(t);
+            }
+        }
+        state.triangles[from].clear();
+        state.removed[from] = true;
+    }
+
+    state.quadrics[_group[collapse.to[0]]] += state.quadrics[_group[collapse.from[0]]];
+    state.maxCost = std::max(state.maxCost, collapse.cost);
+}
+
+void MeshSimplifier::pushCandidates(State& state, uint32_t vertex) const {
+    Collapse collapse;
+    for (uint32_t t : state.triangles[vertex]) {
+        if (state.dead[t]) {
+            continue;
+        }
+        for (int k = 0; k < 3; ++k) {
+            const uint32_t other = state.indices[3 * t + k];
+            if (other == vertex) {
+                continue;
+            }
+            if (plan(state, other, vertex, collapse)) {
+                state.heap.push({collapse.cost, other, vertex});
+            }
+            if (plan(state, vertex, other, collapse)) {
+                state.heap.push({collapse.cost, vertex, other});
+            }
+        }
+    }
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vertex.h"
+
+// quadric error edge collapse (garland and heckbert). a vertex collapses onto one of its
+// neighbours, which stays where it is, so every level indexes the vertices of the input
+// and all levels can share one vertex buffer.
+//
+// the error of a collapse is the mean squared distance of the moved vertex to the planes
+// of the triangles merged into both ends, plus a term for the difference of their normals
+// and texture coordinates. vertices sharing a position with different attributes form a
+// uv or normal seam, they only collapse along the seam together with their partner on the
+// other side. vertices on an open border only collapse along it, and planes through the
+// border edges keep it in place. corners where more than two seams or borders meet never
+// move
+class MeshSimplifier {
+public:
+    struct Level {
+        std::vector<uint32_t> indices;
+        float error = 0.0f; // largest collapse error so far, in the units of the positions
+    };
+
+    MeshSimplifier(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+
+    // collapses edges down to each of the decreasing targetIndexCounts in turn, in one pass,
+    // and returns a level per count reached. stops early when the next collapse would
+    // exceed maxError or none is left, so fewer levels may come back
+    std::vector<Level> simplify(const std::vector<size_t>& targetIndexCounts, float maxError) const;
+
+    // length of the diagonal of the bounding box, for errors relative to the mesh size
+    float getExtent() const;
+
+private:
+    // symmetric 4x4 matrix of the plane equations, divided by weight when evaluated
+    struct Quadric {
+        double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+        double a11 = 0, a12 = 0, a13 = 0;
+        double a22 = 0, a23 = 0;
+        double a33 = 0;
+        double weight = 0;
+
+        Quadric& operator+=(const Quadric& rhs);
+
+        // plane n.p + d = 0 with a unit normal
+        static Quadric fromPlane(const glm::dvec3& n, double d, double weight);
+
+        double evaluate(const glm::vec3& p) const;
+    };
+
+    enum class Kind : uint8_t {
+        Manifold, // one wedge, surrounded by triangles
+        Border, // one wedge on an open edge
+        Seam, // two wedges at the same position
+        Locked
+    };
+
+    // a vertex moving onto another one, with the partner of a seam vertex
+    struct Collapse {
+        uint32_t from[2];
+        uint32_t to[2];
+        int count = 0;
+        float cost = 0.0f;
+    };
+
+    // state of one simplify() run
+    struct State;
+
+    std::vector<Vertex> _vertices;
+    std::vector<uint32_t> _indices; // without degenerate triangles
+
+    std::vector<uint32_t> _group; // first vertex at the same position
+    std::vector<uint32_t> _nextWedge; // ring through the vertices at the same position
+    std::vector<Kind> _kinds; // per group
+    std::vector<Quadric> _quadrics; // per group
+
+    float _extent = 0.0f;
+
+    // groups the vertices by position, finds seams and borders and sums the quadrics
+    void classify();
+
+    // checks that from may move onto to along an edge of the current triangles of state
+    // and prices the collapse
+    bool plan(const State& state, uint32_t from, uint32_t to, Collapse& collapse) const;
+
+    // the link condition and no triangle turning over
+    bool preservesSurface(const State& state, const Collapse& collapse) const;
+
+    // the vertex of the triangle at the position of group, or an invalid index
+    uint32_t findWedge(const State& state, uint32_t triangle, uint32_t group) const;
+
+    void apply(State& state, const Collapse& collapse) const;
+
+    // queues the collapses of the edges around vertex
+    void pushCandidates(State& state, uint32_t vertex) const;
+};
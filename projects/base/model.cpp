@@ -7,6 +7,8 @@
 
 #include <tiny_obj_loader.h>
 
+#include "gl_state_cache.h"
+#include "mesh_simplifier.h"
 #include "model.h"
 
 Model::Model(const std::string& filepath) {
@@ -69,6 +71,8 @@ Model::Model(const std::string& filepath) {
     _vertices = vertices;
     _indices = indices;
 
+    optimizeMesh();
+
     computeBoundingBox();
 
     initGLResources();
@@ -179,6 +183,8 @@ Model::Model(const std::string& filename,bool myloader){
     }
     file.close();
 
+    optimizeMesh();
+
     computeBoundingBox();
 
     initGLResources();
@@ -195,6 +201,8 @@ Model::Model(const std::string& filename,bool myloader){
 Model::Model(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
     : _vertices(vertices), _indices(indices) {
 
+    optimizeMesh();
+
     computeBoundingBox();
 
     initGLResources();
@@ -210,14 +218,19 @@ Model::Model(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& i
 
 Model::Model(Model&& rhs) noexcept
     : _vertices(std::move(rhs._vertices)), _indices(std::move(rhs._indices)),
-      _boundingBox(std::move(rhs._boundingBox)), _vao(rhs._vao), _vbo(rhs._vbo), _ebo(rhs._ebo),
-      _boxVao(rhs._boxVao), _boxVbo(rhs._boxVbo), _boxEbo(rhs._boxEbo) {
-    _vao = 0;
-    _vbo = 0;
-    _ebo = 0;
-    _boxVao = 0;
-    _boxVbo = 0;
-    _boxEbo = 0;
+      _lods(std::move(rhs._lods)), _lodIndices(std::move(rhs._lodIndices)),
+      _meshReport(rhs._meshReport), _boundingBox(std::move(rhs._boundingBox)), _vao(rhs._vao),
+      _vbo(rhs._vbo), _ebo(rhs._ebo),
+      _boxVao(rhs._boxVao), _boxVbo(rhs._boxVbo), _boxEbo(rhs._boxEbo),
+      _boxFaceVao(rhs._boxFaceVao), _boxFaceEbo(rhs._boxFaceEbo) {
+    rhs._vao = 0;
+    rhs._vbo = 0;
+    rhs._ebo = 0;
+    rhs._boxVao = 0;
+    rhs._boxVbo = 0;
+    rhs._boxEbo = 0;
+    rhs._boxFaceVao = 0;
+    rhs._boxFaceEbo = 0;
 }
 Model& Model::operator=(Model&& rhs) noexcept {
     if (this != &rhs) {
@@ -227,6 +240,9 @@ Model& Model::operator=(Model&& rhs) noexcept {
         // 移动赋值资源
         _vertices = std::move(rhs._vertices);
         _indices = std::move(rhs._indices);
+        _lods = std::move(rhs._lods);
+        _lodIndices = std::move(rhs._lodIndices);
+        _meshReport = rhs._meshReport;
         _boundingBox = std::move(rhs._boundingBox);
         // 还可以继续移动其他成员
 
@@ -237,6 +253,8 @@ Model& Model::operator=(Model&& rhs) noexcept {
         rhs._boxVao = 0;
         rhs._boxVbo = 0;
         rhs._boxEbo = 0;
+        rhs._boxFaceVao = 0;
+        rhs._boxFaceEbo = 0;
     }
     return *this;
 }
@@ -249,16 +267,93 @@ BoundingBox Model::getBoundingBox() const {
     return _boundingBox;
 }
 
+const BoundingBox& Model::getWorldBoundingBox() const {
+    if (_worldBoundingBoxVersion != transform.getVersion()) {
+        _worldBoundingBox = _boundingBox.transform(transform.getLocalMatrix());
+        _worldBoundingBoxVersion = transform.getVersion();
+    }
+
+    return _worldBoundingBox;
+}
+
 void Model::draw() const {
-    glBindVertexArray(_vao);
+    GLStateCache::instance().bindVertexArray(_vao);
     glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(_indices.size()), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+}
+
+void Model::generateLods(size_t levelCount, float maxRelativeError) {
+    std::vector<size_t> targets;
+    size_t target = _indices.size();
+    for (size_t level = 1; level < levelCount; ++level) {
+        target = target / 6 * 3;
+        targets.push_back(target);
+    }
+
+    const MeshSimplifier simplifier(_vertices, _indices);
+    _lods.clear();
+    _lodIndices.clear();
+    for (auto& level : simplifier.simplify(targets, maxRelativeError * simplifier.getExtent())) {
+        // collapses leave the triangles in their old order, reorder every level like the mesh
+        MeshOptimizer::optimizeVertexCache(level.indices, _vertices.size());
+        MeshOptimizer::optimizeOverdraw(level.indices, _vertices);
+        Lod lod;
+        lod.firstIndex = static_cast<GLsizei>(_indices.size() + _lodIndices.size());
+        lod.indexCount = static_cast<GLsizei>(level.indices.size());
+        lod.error = level.error;
+        _lods.push_back(lod);
+        _lodIndices.insert(_lodIndices.end(), level.indices.begin(), level.indices.end());
+    }
+
+    // the full mesh stays at the front, draws of the whole index list are unchanged
+    std::vector<uint32_t> indices = _indices;
+    indices.insert(indices.end(), _lodIndices.begin(), _lodIndices.end());
+    GLStateCache::instance().bindVertexArray(_vao);
+    GLStateCache::instance().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
+    glBufferData(
+        GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(),
+        GL_STATIC_DRAW);
+    GLStateCache::instance().bindVertexArray(0);
+}
+
+size_t Model::getLodCount() const {
+    return _lods.size() + 1;
+}
+
+Model::Lod Model::getLod(size_t level) const {
+    if (level == 0) {
+        Lod full;
+        full.indexCount = static_cast<GLsizei>(_indices.size());
+        return full;
+    }
+
+    return _lods[level - 1];
+}
+
+size_t Model::selectLod(float distance, float maxErrorPerDistance) const {
+    size_t level = 0;
+    while (level < _lods.size() && _lods[level].error <= maxErrorPerDistance * distance) {
+        ++level;
+    }
+
+    return level;
+}
+
+void Model::drawLod(size_t level) const {
+    const Lod lod = getLod(level);
+    GLStateCache::instance().bindVertexArray(_vao);
+    glDrawElements(
+        GL_TRIANGLES, lod.indexCount, GL_UNSIGNED_INT,
+        reinterpret_cast<const void*>(lod.firstIndex * sizeof(uint32_t)));
 }
 
 void Model::drawBoundingBox() const {
-    glBindVertexArray(_boxVao);
+    GLStateCache::instance().bindVertexArray(_boxVao);
     glDrawElements(GL_LINES, 24, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+}
+
+void Model::drawBoundingBoxFaces() const {
+    GLStateCache::instance().bindVertexArray(_boxFaceVao);
+    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
 }
 
 GLuint Model::getVao() const {
@@ -269,6 +364,22 @@ GLuint Model::getBoundingBoxVao() const {
     return _boxVao;
 }
 
+GLuint Model::getVbo() const {
+    return _vbo;
+}
+
+GLuint Model::getEbo() const {
+    return _ebo;
+}
+
+GLuint Model::getBoundingBoxVbo() const {
+    return _boxVbo;
+}
+
+GLuint Model::getBoundingBoxEbo() const {
+    return _boxEbo;
+}
+
 size_t Model::getVertexCount() const {
     return _vertices.size();
 }
@@ -277,6 +388,10 @@ size_t Model::getFaceCount() const {
     return _indices.size() / 3;
 }
 
+void Model::optimizeMesh() {
+    _meshReport = MeshOptimizer::optimize(_vertices, _indices);
+}
+
 void Model::initGLResources() {
     // create a vertex array object
     glGenVertexArrays(1, &_vao);
@@ -285,12 +400,12 @@ void Model::initGLResources() {
     // create a element array buffer
     glGenBuffers(1, &_ebo);
 
-    glBindVertexArray(_vao);
-    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+    GLStateCache::instance().bindVertexArray(_vao);
+    GLStateCache::instance().bindBuffer(GL_ARRAY_BUFFER, _vbo);
     glBufferData(
         GL_ARRAY_BUFFER, sizeof(Vertex) * _vertices.size(), _vertices.data(), GL_STATIC_DRAW);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
+    GLStateCache::instance().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
     glBufferData(
         GL_ELEMENT_ARRAY_BUFFER, _indices.size() * sizeof(uint32_t), _indices.data(),
         GL_STATIC_DRAW);
@@ -307,7 +422,7 @@ void Model::initGLResources() {
         2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));
     glEnableVertexAttribArray(2);
 
-    glBindVertexArray(0);
+    GLStateCache::instance().bindVertexArray(0);
 }
 
 void Model::computeBoundingBox() {
@@ -350,13 +465,13 @@ void Model::initBoxGLResources() {
     glGenBuffers(1, &_boxVbo);
     glGenBuffers(1, &_boxEbo);
 
-    glBindVertexArray(_boxVao);
-    glBindBuffer(GL_ARRAY_BUFFER, _boxVbo);
+    GLStateCache::instance().bindVertexArray(_boxVao);
+    GLStateCache::instance().bindBuffer(GL_ARRAY_BUFFER, _boxVbo);
     glBufferData(
         GL_ARRAY_BUFFER, boxVertices.size() * sizeof(glm::vec3), boxVertices.data(),
         GL_STATIC_DRAW);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _boxEbo);
+    GLStateCache::instance().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, _boxEbo);
     glBufferData(
         GL_ELEMENT_ARRAY_BUFFER, boxIndices.size() * sizeof(uint32_t), boxIndices.data(),
         GL_STATIC_DRAW);
@@ -364,36 +479,72 @@ void Model::initBoxGLResources() {
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
     glEnableVertexAttribArray(0);
 
-    glBindVertexArray(0);
+    // the same corners closed into faces, counter clockwise seen from outside
+    std::vector<uint32_t> boxFaceIndices = {0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6,
+                                            0, 1, 4, 1, 5, 4, 2, 6, 3, 3, 6, 7,
+                                            0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5};
+
+    glGenVertexArrays(1, &_boxFaceVao);
+    glGenBuffers(1, &_boxFaceEbo);
+
+    GLStateCache::instance().bindVertexArray(_boxFaceVao);
+    GLStateCache::instance().bindBuffer(GL_ARRAY_BUFFER, _boxVbo);
+    GLStateCache::instance().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, _boxFaceEbo);
+    glBufferData(
+        GL_ELEMENT_ARRAY_BUFFER, boxFaceIndices.size() * sizeof(uint32_t), boxFaceIndices.data(),
+        GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
+    glEnableVertexAttribArray(0);
+
+    GLStateCache::instance().bindVertexArray(0);
 }
 
 void Model::cleanup() {
+    if (_boxFaceEbo) {
+        GLStateCache::instance().forgetBuffer(_boxFaceEbo);
+        glDeleteBuffers(1, &_boxFaceEbo);
+        _boxFaceEbo = 0;
+    }
+
+    if (_boxFaceVao) {
+        GLStateCache::instance().forgetVertexArray(_boxFaceVao);
+        glDeleteVertexArrays(1, &_boxFaceVao);
+        _boxFaceVao = 0;
+    }
+
     if (_boxEbo) {
+        GLStateCache::instance().forgetBuffer(_boxEbo);
         glDeleteBuffers(1, &_boxEbo);
         _boxEbo = 0;
     }
 
     if (_boxVbo) {
+        GLStateCache::instance().forgetBuffer(_boxVbo);
         glDeleteBuffers(1, &_boxVbo);
         _boxVbo = 0;
     }
 
     if (_boxVao) {
+        GLStateCache::instance().forgetVertexArray(_boxVao);
         glDeleteVertexArrays(1, &_boxVao);
         _boxVao = 0;
     }
 
     if (_ebo != 0) {
+        GLStateCache::instance().forgetBuffer(_ebo);
         glDeleteBuffers(1, &_ebo);
         _ebo = 0;
     }
 
     if (_vbo != 0) {
+        GLStateCache::instance().forgetBuffer(_vbo);
         glDeleteBuffers(1, &_vbo);
         _vbo = 0;
     }
 
     if (_vao != 0) {
+        GLStateCache::instance().forgetVertexArray(_vao);
         glDeleteVertexArrays(1, &_vao);
         _vao = 0;
     }
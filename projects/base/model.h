@@ -5,11 +5,19 @@
 
 #include "bounding_box.h"
 #include "gl_utility.h"
+#include "mesh_optimizer.h"
 #include "transform.h"
 #include "vertex.h"
 
 class Model {
 public:
+    // a level of detail, a range of the index buffer over the same vertices
+    struct Lod {
+        GLsizei firstIndex = 0;
+        GLsizei indexCount = 0;
+        float error = 0.0f; // largest distance to the full mesh, in model units
+    };
+
     Model() = default;
 
     Model(const std::string& filepath);
@@ -27,16 +35,51 @@ public:
 
     GLuint getBoundingBoxVao() const;
 
+    GLuint getVbo() const;
+
+    GLuint getEbo() const;
+
+    GLuint getBoundingBoxVbo() const;
+
+    GLuint getBoundingBoxEbo() const;
+
     size_t getVertexCount() const;
 
     size_t getFaceCount() const;
 
     BoundingBox getBoundingBox() const;
 
+    // bounding box under transform, rebuilt only when the transform changes
+    const BoundingBox& getWorldBoundingBox() const;
+
     virtual void draw() const;
 
+    // simplifies the mesh into up to levelCount - 1 coarser levels with half the triangles
+    // of the one before each, errors limited to maxRelativeError of the bounding box
+    // diagonal. their indices go to the index buffer behind the full mesh
+    void generateLods(size_t levelCount, float maxRelativeError = 0.05f);
+
+    // level 0 is the full mesh
+    size_t getLodCount() const;
+
+    Lod getLod(size_t level) const;
+
+    // the coarsest level whose error seen from distance stays below maxErrorPerDistance,
+    // e.g. the size of a pixel at distance 1. distance in model units
+    size_t selectLod(float distance, float maxErrorPerDistance) const;
+
+    void drawLod(size_t level) const;
+
     virtual void drawBoundingBox() const;
 
+    // the bounding box as 12 solid triangles, e.g. as an occlusion query proxy
+    void drawBoundingBoxFaces() const;
+
+    // vertex cache efficiency before and after the mesh was reordered at load
+    const MeshOptimizer::Report& getMeshReport() const {
+        return _meshReport;
+    }
+
     const std::vector<uint32_t>& getIndices() const {
         return _indices;
     }
@@ -55,9 +98,18 @@ protected:
     std::vector<Vertex> _vertices;
     std::vector<uint32_t> _indices;
 
+    // coarser levels of detail, their indices follow _indices in the index buffer
+    std::vector<Lod> _lods;
+    std::vector<uint32_t> _lodIndices;
+
+    MeshOptimizer::Report _meshReport;
+
     // bounding box
     BoundingBox _boundingBox;
 
+    mutable BoundingBox _worldBoundingBox;
+    mutable uint64_t _worldBoundingBoxVersion = 0;
+
     // opengl objects
     GLuint _vao = 0;
     GLuint _vbo = 0;
@@ -67,8 +119,14 @@ protected:
     GLuint _boxVbo = 0;
     GLuint _boxEbo = 0;
 
+    GLuint _boxFaceVao = 0;
+    GLuint _boxFaceEbo = 0;
+
     void computeBoundingBox();
 
+    // reorders _indices and _vertices for the vertex cache, overdraw and vertex fetch
+    void optimizeMesh();
+
     void initGLResources();
 
     void initBoxGLResources();
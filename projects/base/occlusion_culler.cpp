@@ -0,0 +1,184 @@
+#include <sstream>
+#include <stdexcept>
+
+#include "gl_state_cache.h"
+#include "occlusion_culler.h"
+
+OcclusionCuller::OcclusionCuller() {
+    const char* vsCode =
+        "#version 330 core\n"
+        "layout(location = 0) in vec3 aPosition;\n"
+        "uniform mat4 projection;\n"
+        "uniform mat4 view;\n"
+        "uniform mat4 model;\n"
+        "void main() {\n"
+        "   gl_Position = projection * view * model * vec4(aPosition, 1.0f);\n"
+        "}\n";
+
+    const char* fsCode =
+        "#version 330 core\n"
+        "out vec4 color;\n"
+        "void main() {\n"
+        "   color = vec4(1.0f);\n"
+        "}\n";
+
+    _shader.reset(new GLSLProgram);
+    _shader->attachVertexShader(vsCode);
+    _shader->attachFragmentShader(fsCode);
+    _shader->link();
+    _projectionUniform = _shader->getUniformHandle<glm::mat4>("projection");
+    _viewUniform = _shader->getUniformHandle<glm::mat4>("view");
+    _modelUniform = _shader->getUniformHandle<glm::mat4>("model");
+
+    GLenum error = glGetError();
+    if (error != GL_NO_ERROR) {
+        std::stringstream ss;
+        ss << "occlusion culler creation failure, (code " << error << ")";
+        throw std::runtime_error(ss.str());
+    }
+}
+
+OcclusionCuller::~OcclusionCuller() {
+    clear();
+    if (!_freeQueries.empty()) {
+        glDeleteQueries(static_cast<GLsizei>(_freeQueries.size()), _freeQueries.data());
+    }
+}
+
+void OcclusionCuller::beginFrame() {
+    ++_frame;
+
+    for (auto& item : _entries) {
+        Entry& entry = item.second;
+        if (!entry.pending) {
+            continue;
+        }
+
+        GLuint available = 0;
+        glGetQueryObjectuiv(entry.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            continue;
+        }
+
+        GLuint samplesPassed = 0;
+        glGetQueryObjectuiv(entry.query, GL_QUERY_RESULT, &samplesPassed);
+        entry.pending = false;
+
+        const bool wasVisible = entry.visible;
+        if (samplesPassed) {
+            entry.occludedCount = 0;
+            entry.visible = true;
+        } else if (++entry.occludedCount >= hideThreshold) {
+            entry.visible = false;
+        }
+
+        if (wasVisible != entry.visible) {
+            entry.visible ? --_hiddenCount : ++_hiddenCount;
+        }
+    }
+}
+
+bool OcclusionCuller::isVisible(uint64_t id) const {
+    auto it = _entries.find(id);
+    if (it == _entries.end()) {
+        return true;
+    }
+
+    // the state of an object that left the view is stale, draw it until queried again
+    return it->second.visible || it->second.lastQueryFrame + 1 < _frame;
+}
+
+void OcclusionCuller::beginQueries(const glm::mat4& projection, const glm::mat4& view) {
+    _eye = glm::vec3(glm::inverse(view)[3]);
+
+    _shader->use();
+    _shader->setUniform(_projectionUniform, projection);
+    _shader->setUniform(_viewUniform, view);
+
+    GLStateCache::instance().colorMask(false, false, false, false);
+    GLStateCache::instance().depthMask(false);
+
+    // a drawn object must not occlude its own box, which may coincide with its surface
+    GLStateCache::instance().depthFunc(GL_LEQUAL);
+    GLStateCache::instance().setEnabled(GL_POLYGON_OFFSET_FILL, true);
+    GLStateCache::instance().polygonOffset(-1.0f, -1.0f);
+}
+
+void OcclusionCuller::query(
+    uint64_t id, const Model& mesh, const glm::mat4& model, const BoundingBox& worldBox) {
+    Entry& entry = _entries[id];
+    const bool wasVisible = entry.visible;
+    const bool stale = entry.lastQueryFrame + 1 < _frame;
+    entry.lastQueryFrame = _frame;
+
+    // with the camera inside the box the proxy is clipped and would report occluded
+    const bool eyeInside = glm::all(glm::greaterThanEqual(_eye, worldBox.min))
+                           && glm::all(glm::lessThanEqual(_eye, worldBox.max));
+    if (stale || eyeInside) {
+        entry.occludedCount = 0;
+        entry.visible = true;
+    }
+    if (wasVisible != entry.visible) {
+        --_hiddenCount;
+    }
+
+    // a query still in flight keeps its slot, it is read in a later frame
+    if (entry.pending) {
+        return;
+    }
+
+    if (entry.query == 0) {
+        if (_freeQueries.empty()) {
+            glGenQueries(1, &entry.query);
+        } else {
+            entry.query = _freeQueries.back();
+            _freeQueries.pop_back();
+        }
+    }
+
+    _shader->setUniform(_modelUniform, model);
+    glBeginQuery(GL_ANY_SAMPLES_PASSED, entry.query);
+    mesh.drawBoundingBoxFaces();
+    glEndQuery(GL_ANY_SAMPLES_PASSED);
+    entry.pending = true;
+}
+
+void OcclusionCuller::endQueries() {
+    GLStateCache::instance().setEnabled(GL_POLYGON_OFFSET_FILL, false);
+    GLStateCache::instance().depthFunc(GL_LESS);
+    GLStateCache::instance().depthMask(true);
+    GLStateCache::instance().colorMask(true, true, true, true);
+}
+
+void OcclusionCuller::remove(uint64_t id) {
+    auto it = _entries.find(id);
+    if (it == _entries.end()) {
+        return;
+    }
+
+    release(it->second);
+    _entries.erase(it);
+}
+
+void OcclusionCuller::clear() {
+    for (auto& item : _entries) {
+        release(item.second);
+    }
+    _entries.clear();
+}
+
+size_t OcclusionCuller::getHiddenCount() const {
+    return _hiddenCount;
+}
+
+void OcclusionCuller::release(Entry& entry) {
+    if (!entry.visible) {
+        --_hiddenCount;
+    }
+
+    if (entry.query != 0) {
+        // a pending result is simply never read, the query object can be reused at once
+        _freeQueries.push_back(entry.query);
+        entry.query = 0;
+    }
+}
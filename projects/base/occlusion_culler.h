@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bounding_box.h"
+#include "gl_utility.h"
+#include "glsl_program.h"
+#include "model.h"
+
+// hardware occlusion culling: after the frame's geometry is drawn, the bounding box of
+// every candidate is tested against the depth buffer with a GL_ANY_SAMPLES_PASSED query.
+// results are collected a frame or more later so the cpu never waits for the gpu. an
+// object is hidden only after several occluded results in a row, and shown again on
+// its first visible result, so objects at the edge of an occluder do not flicker
+class OcclusionCuller {
+public:
+    OcclusionCuller();
+
+    OcclusionCuller(const OcclusionCuller&) = delete;
+
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+    ~OcclusionCuller();
+
+    // collects the results that became available, call once per frame before isVisible
+    void beginFrame();
+
+    // unknown objects and objects not queried in the previous frame count as visible
+    bool isVisible(uint64_t id) const;
+
+    // binds the proxy shader, turns color and depth writes off and biases the depth test
+    // so that an object drawn this frame never hides its own box
+    void beginQueries(const glm::mat4& projection, const glm::mat4& view);
+
+    // tests the box of mesh under model, worldBox is its world bounding box and decides
+    // whether the camera is inside the box, where the proxy faces would be clipped away
+    void query(uint64_t id, const Model& mesh, const glm::mat4& model, const BoundingBox& worldBox);
+
+    // restores the write masks and the default depth test
+    void endQueries();
+
+    // forget an object that will not be drawn again
+    void remove(uint64_t id);
+
+    void clear();
+
+    size_t getHiddenCount() const;
+
+private:
+    struct Entry {
+        GLuint query = 0;
+        bool pending = false;
+        bool visible = true;
+        uint32_t occludedCount = 0;
+        uint64_t lastQueryFrame = 0;
+    };
+
+    // number of occluded results in a row before an object is hidden
+    static constexpr uint32_t hideThreshold = 3;
+
+    std::unordered_map<uint64_t, Entry> _entries;
+
+    std::vector<GLuint> _freeQueries;
+
+    std::unique_ptr<GLSLProgram> _shader;
+    UniformHandle<glm::mat4> _projectionUniform;
+    UniformHandle<glm::mat4> _viewUniform;
+    UniformHandle<glm::mat4> _modelUniform;
+
+    uint64_t _frame = 0;
+
+    size_t _hiddenCount = 0;
+
+    glm::vec3 _eye = glm::vec3(0.0f);
+
+    void release(Entry& entry);
+};
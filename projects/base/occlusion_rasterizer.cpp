@@ -0,0 +1,272 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "occlusion_rasterizer.h"
+#include "simd.h"
+
+namespace {
+// relative depth slack, so an occluder never hides the box around itself
+constexpr float depthEpsilon = 1e-4f;
+} // namespace
+
+OcclusionRasterizer::OcclusionRasterizer(int width, int height, ThreadPool* threadPool)
+    : _width(width), _height(height), _tileColumns(width / tileWidth),
+      _tileRows(height / tileHeight), _threadPool(threadPool) {
+    if (width <= 0 || height <= 0 || width % tileWidth != 0 || height % tileHeight != 0) {
+        throw std::runtime_error("occlusion rasterizer size must be a multiple of the tile size");
+    }
+
+    _depth.resize(static_cast<size_t>(_width) * _height, 0.0f);
+    _tileDepth.resize(static_cast<size_t>(_tileColumns) * _tileRows, 0.0f);
+}
+
+void OcclusionRasterizer::beginFrame(const Camera& camera) {
+    _viewProjection = camera.getProjectionMatrix() * camera.getViewMatrix();
+    _frustum = camera.getFrustum();
+    _triangles.clear();
+}
+
+void OcclusionRasterizer::addOccluder(
+    const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+    const glm::mat4& model) {
+    const glm::mat4 mvp = _viewProjection * model;
+    _clipVertices.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        _clipVertices[i] = mvp * glm::vec4(vertices[i].position, 1.0f);
+    }
+
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        addTriangle(
+            _clipVertices[indices[i]], _clipVertices[indices[i + 1]],
+            _clipVertices[indices[i + 2]]);
+    }
+}
+
+void OcclusionRasterizer::rasterize() {
+    if (_threadPool != nullptr) {
+        _threadPool->parallelFor(
+            static_cast<size_t>(_tileRows),
+            [this](size_t tileRow) { rasterizeTileRow(static_cast<int>(tileRow)); });
+    } else {
+        for (int tileRow = 0; tileRow < _tileRows; ++tileRow) {
+            rasterizeTileRow(tileRow);
+        }
+    }
+}
+
+bool OcclusionRasterizer::isVisible(const BoundingBox& worldBox) const {
+    if (!_frustum.intersect(worldBox)) {
+        return false;
+    }
+
+    const glm::vec3& lo = worldBox.min;
+    const glm::vec3& hi = worldBox.max;
+    const glm::vec3 corners[8] = {
+        {lo.x, lo.y, lo.z}, {lo.x, lo.y, hi.z}, {lo.x, hi.y, lo.z}, {lo.x, hi.y, hi.z},
+        {hi.x, lo.y, lo.z}, {hi.x, lo.y, hi.z}, {hi.x, hi.y, lo.z}, {hi.x, hi.y, hi.z}};
+
+    glm::vec2 screenMin(std::numeric_limits<float>::max());
+    glm::vec2 screenMax(-std::numeric_limits<float>::max());
+    float nearest = 0.0f;
+    for (const auto& corner : corners) {
+        const glm::vec4 clip = _viewProjection * glm::vec4(corner, 1.0f);
+        if (clip.z < -clip.w) {
+            // the box reaches through the near plane
+            return true;
+        }
+
+        const glm::vec3 screen = toScreen(clip);
+        screenMin = glm::min(screenMin, glm::vec2(screen));
+        screenMax = glm::max(screenMax, glm::vec2(screen));
+        nearest = std::max(nearest, screen.z);
+    }
+
+    const int minX = std::max(0, static_cast<int>(std::floor(screenMin.x)));
+    const int maxX = std::min(_width - 1, static_cast<int>(std::floor(screenMax.x)));
+    const int minY = std::max(0, static_cast<int>(std::floor(screenMin.y)));
+    const int maxY = std::min(_height - 1, static_cast<int>(std::floor(screenMax.y)));
+    if (minX > maxX || minY > maxY) {
+        return false;
+    }
+
+    const float depth = nearest * (1.0f + depthEpsilon);
+    for (int tileY = minY / tileHeight; tileY <= maxY / tileHeight; ++tileY) {
+        for (int tileX = minX / tileWidth; tileX <= maxX / tileWidth; ++tileX) {
+            if (_tileDepth[tileY * _tileColumns + tileX] > depth) {
+                continue; // the whole tile is nearer than the box
+            }
+
+            const int rowEnd = std::min(maxY, tileY * tileHeight + tileHeight - 1);
+            const int columnEnd = std::min(maxX, tileX * tileWidth + tileWidth - 1);
+            for (int y = std::max(minY, tileY * tileHeight); y <= rowEnd; ++y) {
+                const float* row = &_depth[static_cast<size_t>(y) * _width];
+                for (int x = std::max(minX, tileX * tileWidth); x <= columnEnd; ++x) {
+                    if (row[x] <= depth) {
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+int OcclusionRasterizer::getWidth() const {
+    return _width;
+}
+
+int OcclusionRasterizer::getHeight() const {
+    return _height;
+}
+
+size_t OcclusionRasterizer::getTriangleCount() const {
+    return _triangles.size();
+}
+
+void OcclusionRasterizer::addTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c) {
+    // clip against the near plane z = -w, which may leave a quad
+    const glm::vec4 input[3] = {a, b, c};
+    glm::vec4 output[4];
+    int count = 0;
+    for (int i = 0; i < 3; ++i) {
+        const glm::vec4& p = input[i];
+        const glm::vec4& q = input[(i + 1) % 3];
+        const float dp = p.z + p.w;
+        const float dq = q.z + q.w;
+        if (dp >= 0.0f) {
+            output[count++] = p;
+        }
+        if ((dp >= 0.0f) != (dq >= 0.0f)) {
+            output[count++] = p + (q - p) * (dp / (dp - dq));
+        }
+    }
+
+    for (int i = 2; i < count; ++i) {
+        addScreenTriangle(output[0], output[i - 1], output[i]);
+    }
+}
+
+void OcclusionRasterizer::addScreenTriangle(
+    const glm::vec4& a, const glm::vec4& b, const glm::vec4& c) {
+    Triangle triangle;
+    triangle.v[0] = toScreen(a);
+    triangle.v[1] = toScreen(b);
+    triangle.v[2] = toScreen(c);
+
+    const glm::vec3& v0 = triangle.v[0];
+    const float area = (triangle.v[1].x - v0.x) * (triangle.v[2].y - v0.y)
+                       - (triangle.v[2].x - v0.x) * (triangle.v[1].y - v0.y);
+    if (std::abs(area) < 1e-6f) {
+        return;
+    }
+    if (area < 0.0f) {
+        std::swap(triangle.v[1], triangle.v[2]);
+    }
+
+    // pixels whose centers may lie inside
+    const float minX = std::min({triangle.v[0].x, triangle.v[1].x, triangle.v[2].x});
+    const float maxX = std::max({triangle.v[0].x, triangle.v[1].x, triangle.v[2].x});
+    const float minY = std::min({triangle.v[0].y, triangle.v[1].y, triangle.v[2].y});
+    const float maxY = std::max({triangle.v[0].y, triangle.v[1].y, triangle.v[2].y});
+    triangle.minX = std::max(0, static_cast<int>(std::floor(std::max(minX, -1.0f))));
+    triangle.maxX = std::min(_width - 1, static_cast<int>(std::min(maxX, float(_width))));
+    triangle.minY = std::max(0, static_cast<int>(std::floor(std::max(minY, -1.0f))));
+    triangle.maxY = std::min(_height - 1, static_cast<int>(std::min(maxY, float(_height))));
+    if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+        return;
+    }
+
+    _triangles.push_back(triangle);
+}
+
+void OcclusionRasterizer::rasterizeTileRow(int tileRow) {
+    const int rowBegin = tileRow * tileHeight;
+    const int rowEnd = rowBegin + tileHeight; // exclusive
+
+    for (int y = rowBegin; y < rowEnd; ++y) {
+        std::fill_n(&_depth[static_cast<size_t>(y) * _width], _width, 0.0f);
+    }
+
+    for (const auto& triangle : _triangles) {
+        if (triangle.maxY < rowBegin || triangle.minY >= rowEnd) {
+            continue;
+        }
+
+        const glm::vec3& v0 = triangle.v[0];
+        const glm::vec3& v1 = triangle.v[1];
+        const glm::vec3& v2 = triangle.v[2];
+
+        // edge functions e(x, y) = a * x + b * y + c, positive inside
+        const float a0 = v0.y - v1.y, b0 = v1.x - v0.x, c0 = -(a0 * v0.x + b0 * v0.y);
+        const float a1 = v1.y - v2.y, b1 = v2.x - v1.x, c1 = -(a1 * v1.x + b1 * v1.y);
+        const float a2 = v2.y - v0.y, b2 = v0.x - v2.x, c2 = -(a2 * v2.x + b2 * v2.y);
+
+        // depth plane through the three vertices
+        const float area = b0 * (v2.y - v0.y) + a0 * (v2.x - v0.x);
+        const float dzdx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+        const float dzdy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+        const float dzc = v0.z - dzdx * v0.x - dzdy * v0.y;
+
+        const int first = std::max(rowBegin, triangle.minY);
+        const int last = std::min(rowEnd - 1, triangle.maxY);
+        for (int y = first; y <= last; ++y) {
+            const float py = static_cast<float>(y) + 0.5f;
+            float* row = &_depth[static_cast<size_t>(y) * _width];
+            int x = triangle.minX;
+
+#if defined(CG_SIMD_SSE2)
+            // 4 pixels per step, the width is a multiple of 4 so the last step stays inside
+            x &= ~3;
+            const __m128 lanes = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+            const __m128 rowE0 = _mm_set1_ps(b0 * py + c0);
+            const __m128 rowE1 = _mm_set1_ps(b1 * py + c1);
+            const __m128 rowE2 = _mm_set1_ps(b2 * py + c2);
+            const __m128 rowZ = _mm_set1_ps(dzdy * py + dzc);
+            const __m128 zero = _mm_setzero_ps();
+            for (; x <= triangle.maxX; x += 4) {
+                const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), lanes);
+                const __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a0), px), rowE0);
+                const __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a1), px), rowE1);
+                const __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a2), px), rowE2);
+                const __m128 inside = _mm_and_ps(
+                    _mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)),
+                    _mm_cmpge_ps(e2, zero));
+                if (_mm_movemask_ps(inside) == 0) {
+                    continue;
+                }
+
+                const __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(dzdx), px), rowZ);
+                const __m128 depth = _mm_loadu_ps(row + x);
+                _mm_storeu_ps(row + x, _mm_max_ps(depth, _mm_and_ps(inside, z)));
+            }
+#endif
+
+            for (; x <= triangle.maxX; ++x) {
+                const float px = static_cast<float>(x) + 0.5f;
+                if (a0 * px + b0 * py + c0 >= 0.0f && a1 * px + b1 * py + c1 >= 0.0f
+                    && a2 * px + b2 * py + c2 >= 0.0f) {
+                    row[x] = std::max(row[x], dzdx * px + dzdy * py + dzc);
+                }
+            }
+        }
+    }
+
+    // farthest depth of every tile in the row
+    for (int tileX = 0; tileX < _tileColumns; ++tileX) {
+        float farthest = std::numeric_limits<float>::max();
+        for (int y = rowBegin; y < rowEnd; ++y) {
+            const float* row = &_depth[static_cast<size_t>(y) * _width + tileX * tileWidth];
+            farthest = std::min(farthest, *std::min_element(row, row + tileWidth));
+        }
+        _tileDepth[tileRow * _tileColumns + tileX] = farthest;
+    }
+}
+
+glm::vec3 OcclusionRasterizer::toScreen(const glm::vec4& clip) const {
+    const float invW = 1.0f / clip.w;
+    return glm::vec3(
+        (clip.x * invW * 0.5f + 0.5f) * _width, (clip.y * invW * 0.5f + 0.5f) * _height, invW);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bounding_box.h"
+#include "camera.h"
+#include "frustum.h"
+#include "thread_pool.h"
+#include "vertex.h"
+
+// low resolution depth buffer rasterised on the cpu from a few occluders, so objects can
+// be rejected before anything is submitted to opengl and without a gpu at all. depth is
+// stored as 1/w, which interpolates linearly in screen space, larger values are nearer.
+// the screen is cut into tiles of 32x8 pixels which keep the farthest depth they hold,
+// most tests are decided by these tiles without visiting a pixel. rows of tiles are
+// rasterised in parallel on the thread pool when one is given
+class OcclusionRasterizer {
+public:
+    static constexpr int tileWidth = 32;
+    static constexpr int tileHeight = 8;
+
+    // width and height must be multiples of the tile size
+    OcclusionRasterizer(int width, int height, ThreadPool* threadPool = nullptr);
+
+    // clears the depth buffer and drops the occluders of the previous frame
+    void beginFrame(const Camera& camera);
+
+    // queues the triangles of a mesh placed by model. an occluder must not cover more
+    // than the object it stands for, so pass the render mesh or a shape inside it
+    void addOccluder(
+        const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+        const glm::mat4& model);
+
+    // rasterises the queued occluders and builds the tile depth bounds
+    void rasterize();
+
+    // false when the box is outside the frustum, or when every pixel it may cover holds
+    // an occluder nearer than the nearest point of the box
+    bool isVisible(const BoundingBox& worldBox) const;
+
+    int getWidth() const;
+
+    int getHeight() const;
+
+    size_t getTriangleCount() const;
+
+private:
+    // screen space triangle, counter clockwise, z holds 1/w
+    struct Triangle {
+        glm::vec3 v[3];
+        int minX, maxX, minY, maxY;
+    };
+
+    int _width;
+    int _height;
+    int _tileColumns;
+    int _tileRows;
+
+    ThreadPool* _threadPool;
+
+    glm::mat4 _viewProjection = glm::mat4(1.0f);
+    Frustum _frustum;
+
+    std::vector<Triangle> _triangles;
+
+    std::vector<float> _depth;
+    std::vector<float> _tileDepth; // farthest depth in each tile
+
+    // clip space vertices scratch for addOccluder
+    std::vector<glm::vec4> _clipVertices;
+
+    void addTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+
+    void addScreenTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+
+    void rasterizeTileRow(int tileRow);
+
+    glm::vec3 toScreen(const glm::vec4& clip) const;
+};
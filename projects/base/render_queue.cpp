@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "gl_state_cache.h"
+#include "render_queue.h"
+
+namespace {
+constexpr uint32_t depthBits = 24;
+constexpr uint32_t depthMask = (1u << depthBits) - 1;
+
+const void* indexOffset(const RenderQueue::DrawCall& draw) {
+    return reinterpret_cast<const void*>(draw.firstIndex * sizeof(uint32_t));
+}
+} // namespace
+
+uint8_t RenderQueue::registerShader(GLSLProgram* shader, ShaderSetup setup) {
+    if (_shaders.size() >= noShader) {
+        throw std::runtime_error("render queue: too many shaders");
+    }
+
+    _shaders.push_back(
+        {shader, std::move(setup), shader->getUniformHandle<glm::mat4>("model"),
+         shader->getUniformHandle<glm::mat3>("normalMatrix"), false});
+    return static_cast<uint8_t>(_shaders.size() - 1);
+}
+
+uint8_t RenderQueue::registerMaterial(MaterialSetup setup) {
+    // slot 0 is the empty material
+    if (_materials.empty()) {
+        _materials.push_back(nullptr);
+    }
+    if (_materials.size() > 0xff) {
+        throw std::runtime_error("render queue: too many materials");
+    }
+
+    _materials.push_back(std::move(setup));
+    return static_cast<uint8_t>(_materials.size() - 1);
+}
+
+void RenderQueue::setDepthRange(float maxDepth) {
+    _maxDepth = std::max(maxDepth, 1e-6f);
+}
+
+void RenderQueue::beginFrame() {
+    for (auto& slot : _shaders) {
+        slot.ready = false;
+    }
+    _statistics = Statistics();
+}
+
+void RenderQueue::submit(
+    Pass pass, uint8_t shader, uint8_t material, const DrawCall& draw, float depth,
+    const glm::mat4* model) {
+    Packet packet;
+    packet.shader = shader;
+    packet.material = material;
+    packet.draw = draw;
+    if (model != nullptr) {
+        packet.hasModel = true;
+        packet.model = *model;
+    }
+
+    enqueue(makeKey(pass, shader, material, draw.vao, depth), std::move(packet));
+}
+
+void RenderQueue::submit(Pass pass, float depth, std::function<void()> draw) {
+    Packet packet;
+    packet.custom = std::move(draw);
+
+    enqueue(makeKey(pass, noShader, noMaterial, 0, depth), std::move(packet));
+}
+
+void RenderQueue::flush() {
+    if (!_sorted) {
+        radixSort(_entries, _sortScratch);
+    }
+
+    // nothing is known to be bound at the start of a flush
+    int shader = -1;
+    int material = -1;
+    GLuint vao = 0;
+    bool vaoKnown = false;
+
+    for (const auto& entry : _entries) {
+        const Packet& packet = _packets[entry.index];
+        ++_statistics.drawCount;
+
+        if (packet.custom) {
+            packet.custom();
+            shader = -1;
+            material = -1;
+            vaoKnown = false;
+            continue;
+        }
+
+        ShaderSlot& slot = _shaders[packet.shader];
+        if (shader != packet.shader) {
+            slot.shader->use();
+            if (!slot.ready) {
+                if (slot.setup) {
+                    slot.setup(*slot.shader);
+                }
+                slot.ready = true;
+            }
+            shader = packet.shader;
+            material = -1;
+            ++_statistics.shaderChanges;
+        }
+
+        if (material != packet.material) {
+            if (packet.material != noMaterial) {
+                _materials[packet.material](*slot.shader);
+            }
+            material = packet.material;
+            ++_statistics.materialChanges;
+        }
+
+        if (packet.hasModel) {
+            slot.shader->setUniform(slot.model, packet.model);
+            if (slot.normalMatrix.isValid()) {
+                slot.shader->setUniform(slot.normalMatrix, computeNormalMatrix(packet.model));
+            }
+        }
+
+        if (!vaoKnown || vao != packet.draw.vao) {
+            GLStateCache::instance().bindVertexArray(packet.draw.vao);
+            vao = packet.draw.vao;
+            vaoKnown = true;
+            ++_statistics.vaoChanges;
+        }
+
+        if (packet.draw.instanceCount > 0) {
+            glDrawElementsInstanced(
+                packet.draw.mode, packet.draw.indexCount, GL_UNSIGNED_INT,
+                indexOffset(packet.draw), packet.draw.instanceCount);
+        } else {
+            glDrawElements(
+                packet.draw.mode, packet.draw.indexCount, GL_UNSIGNED_INT,
+                indexOffset(packet.draw));
+        }
+    }
+
+    _packets.clear();
+    _entries.clear();
+    _sorted = false;
+}
+
+void RenderQueue::setDepthShaders(GLSLProgram* plain, GLSLProgram* instanced) {
+    _depthShaders[0] = plain;
+    _depthShaders[1] = instanced;
+    _depthModel = plain != nullptr ? plain->getUniformHandle<glm::mat4>("model")
+                                   : UniformHandle<glm::mat4>();
+}
+
+void RenderQueue::flushDepth() {
+    radixSort(_entries, _sortScratch);
+    _sorted = true;
+
+    // opaque packets sort first, sorted by state the vao changes stay few
+    GLSLProgram* shader = nullptr;
+    GLuint vao = 0;
+    bool vaoKnown = false;
+    for (const auto& entry : _entries) {
+        if (static_cast<Pass>(entry.key >> 60) != Pass::Opaque) {
+            break;
+        }
+
+        const Packet& packet = _packets[entry.index];
+        const bool instanced = packet.draw.instanceCount > 0;
+        GLSLProgram* depthShader = _depthShaders[instanced ? 1 : 0];
+        if (packet.custom || depthShader == nullptr) {
+            continue;
+        }
+
+        if (shader != depthShader) {
+            depthShader->use();
+            shader = depthShader;
+        }
+        if (packet.hasModel && !instanced) {
+            shader->setUniform(_depthModel, packet.model);
+        }
+
+        if (!vaoKnown || vao != packet.draw.vao) {
+            GLStateCache::instance().bindVertexArray(packet.draw.vao);
+            vao = packet.draw.vao;
+            vaoKnown = true;
+        }
+
+        if (instanced) {
+            glDrawElementsInstanced(
+                packet.draw.mode, packet.draw.indexCount, GL_UNSIGNED_INT,
+                indexOffset(packet.draw), packet.draw.instanceCount);
+        } else {
+            glDrawElements(
+                packet.draw.mode, packet.draw.indexCount, GL_UNSIGNED_INT,
+                indexOffset(packet.draw));
+        }
+    }
+}
+
+const RenderQueue::Statistics& RenderQueue::getStatistics() const {
+    return _statistics;
+}
+
+uint64_t RenderQueue::makeKey(
+    Pass pass, uint8_t shader, uint8_t material, GLuint vao, float depth) const {
+    // opaque, background: pass 4 | shader 8 | material 8 | vao 12 | depth 24 | unused 8
+    // transparent:        pass 4 | far to near depth 24 | shader 8 | material 8 | vao 12
+    const uint64_t passBits = static_cast<uint64_t>(pass) << 60;
+    const uint64_t state = (static_cast<uint64_t>(shader) << 20)
+                           | (static_cast<uint64_t>(material) << 12) | (vao & 0xfffu);
+    const uint64_t quantized = quantizeDepth(depth);
+
+    if (pass == Pass::Transparent) {
+        return passBits | ((depthMask - quantized) << 28) | state;
+    }
+
+    return passBits | (state << 32) | (quantized << 8);
+}
+
+uint32_t RenderQueue::quantizeDepth(float depth) const {
+    const float normalized = std::min(std::max(depth / _maxDepth, 0.0f), 1.0f);
+    return static_cast<uint32_t>(normalized * static_cast<float>(depthMask));
+}
+
+void RenderQueue::enqueue(uint64_t key, Packet packet) {
+    _sorted = false;
+    _entries.push_back({key, static_cast<uint32_t>(_packets.size())});
+    _packets.push_back(std::move(packet));
+}
+
+void RenderQueue::radixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch) {
+    if (entries.size() < 2) {
+        return;
+    }
+
+    // one histogram per byte, built in a single pass
+    size_t counts[8][256] = {};
+    for (const auto& entry : entries) {
+        for (int digit = 0; digit < 8; ++digit) {
+            ++counts[digit][(entry.key >> (digit * 8)) & 0xff];
+        }
+    }
+
+    scratch.resize(entries.size());
+    for (int digit = 0; digit < 8; ++digit) {
+        const size_t* count = counts[digit];
+        const uint8_t first = static_cast<uint8_t>(entries.front().key >> (digit * 8));
+        if (count[first] == entries.size()) {
+            continue;
+        }
+
+        size_t offsets[256];
+        size_t sum = 0;
+        for (int value = 0; value < 256; ++value) {
+            offsets[value] = sum;
+            sum += count[value];
+        }
+
+        for (const auto& entry : entries) {
+            scratch[offsets[(entry.key >> (digit * 8)) & 0xff]++] = entry;
+        }
+        entries.swap(scratch);
+    }
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "gl_utility.h"
+#include "glsl_program.h"
+#include "transform.h"
+
+// collects the draws of a frame as packets, orders them by a 64 bit sort key and submits
+// them binding a shader, material or vao only when it differs from the previous packet.
+// opaque packets sort by state first and front to back within the same state, so early
+// depth rejection works, transparent packets sort back to front before anything else
+class RenderQueue {
+public:
+    enum class Pass : uint8_t {
+        Opaque = 0,
+        Background = 1, // e.g. a skybox drawn behind everything with depth test LEQUAL
+        Transparent = 2
+    };
+
+    // runs when the shader becomes current for the first time in a frame and uploads the
+    // uniforms shared by every draw of the frame, e.g. camera and lights
+    using ShaderSetup = std::function<void(GLSLProgram&)>;
+
+    // binds textures and uploads the uniforms of one material
+    using MaterialSetup = std::function<void(GLSLProgram&)>;
+
+    // id of the shader or material slot of draws managing their own state
+    static constexpr uint8_t noShader = 0xff;
+    static constexpr uint8_t noMaterial = 0;
+
+    struct DrawCall {
+        GLuint vao = 0;
+        GLsizei indexCount = 0; // GL_UNSIGNED_INT indices bound to the vao
+        GLsizei firstIndex = 0; // where they start in the bound index buffer
+        GLsizei instanceCount = 0; // 0 for a plain draw
+        GLenum mode = GL_TRIANGLES;
+    };
+
+    uint8_t registerShader(GLSLProgram* shader, ShaderSetup setup);
+
+    uint8_t registerMaterial(MaterialSetup setup);
+
+    // distances are quantised to 24 bits over [0, maxDepth]
+    void setDepthRange(float maxDepth);
+
+    // forgets which shaders were set up, call once at the start of a frame
+    void beginFrame();
+
+    // model is uploaded as the "model" uniform when given, along with its inverse transpose
+    // as "normalMatrix" for shaders declaring one. depth is the view distance
+    void submit(
+        Pass pass, uint8_t shader, uint8_t material, const DrawCall& draw, float depth,
+        const glm::mat4* model = nullptr);
+
+    // a draw that binds everything itself, the queue only orders it
+    void submit(Pass pass, float depth, std::function<void()> draw);
+
+    // sorts and issues the queued packets, then empties the queue. the gl state bound
+    // by the queue is unknown to it across flushes, other code may draw in between
+    void flush();
+
+    // position only programs for flushDepth(), one for plain draws taking a "model"
+    // uniform and one for instanced draws. their gl_Position has to be computed exactly
+    // like in the shading programs (invariant), or the shading pass fails the depth test
+    void setDepthShaders(GLSLProgram* plain, GLSLProgram* instanced);
+
+    // depth pre-pass: draws the queued opaque packets with the depth shaders and keeps
+    // them queued, so the next flush() shades only the fragments that stay visible.
+    // color mask, depth mask and depth function are left to the caller
+    void flushDepth();
+
+    struct Statistics {
+        size_t drawCount = 0;
+        size_t shaderChanges = 0;
+        size_t materialChanges = 0;
+        size_t vaoChanges = 0;
+    };
+
+    // counted since beginFrame
+    const Statistics& getStatistics() const;
+
+    // the key layout, exposed for inspection
+    uint64_t makeKey(Pass pass, uint8_t shader, uint8_t material, GLuint vao, float depth) const;
+
+private:
+    struct ShaderSlot {
+        GLSLProgram* shader;
+        ShaderSetup setup;
+        UniformHandle<glm::mat4> model;
+        UniformHandle<glm::mat3> normalMatrix; // set with the model when the shader has it
+        bool ready = false; // setup ran in this frame
+    };
+
+    struct Packet {
+        uint8_t shader = noShader;
+        uint8_t material = noMaterial;
+        DrawCall draw;
+        bool hasModel = false;
+        glm::mat4 model;
+        std::function<void()> custom;
+    };
+
+    struct SortEntry {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    std::vector<ShaderSlot> _shaders;
+    std::vector<MaterialSetup> _materials;
+
+    float _maxDepth = 1.0f;
+
+    std::vector<Packet> _packets;
+    std::vector<SortEntry> _entries;
+    std::vector<SortEntry> _sortScratch;
+    bool _sorted = false; // nothing was queued since the last sort
+
+    GLSLProgram* _depthShaders[2] = {}; // plain, instanced
+    UniformHandle<glm::mat4> _depthModel;
+
+    Statistics _statistics;
+
+    uint32_t quantizeDepth(float depth) const;
+
+    void enqueue(uint64_t key, Packet packet);
+
+    // stable lsd radix sort by 8 bit digits, digits equal in every key are skipped
+    static void radixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch);
+};
@@ -1,6 +1,6 @@
 #pragma once
 
-#include "gl_utility.h"
+#include "gl_state_cache.h"
 
 class Sampler {
 public:
@@ -15,6 +15,7 @@ public:
 
     ~Sampler() {
         if (_handle != 0) {
+            GLStateCache::instance().forgetSampler(_handle);
             glDeleteSamplers(1, &_handle);
         }
     }
@@ -36,11 +37,11 @@ public:
     }
 
     void bind(GLuint texUnit) const {
-        glBindSampler(texUnit, _handle);
+        GLStateCache::instance().bindSampler(texUnit, _handle);
     }
 
     void unbind(GLuint texUnit) const {
-        glBindSampler(texUnit, 0);
+        GLStateCache::instance().bindSampler(texUnit, 0);
     }
 
 private:
@@ -0,0 +1,88 @@
+#include <stdexcept>
+
+#include "shader_variants.h"
+
+ShaderVariants::ShaderVariants(
+    const std::string& vsCode, const std::string& fsCode,
+    const std::vector<std::string>& featureNames, LinkSetup setup)
+    : _vsCode(vsCode), _fsCode(fsCode), _featureNames(featureNames), _setup(std::move(setup)) {
+    if (_featureNames.size() > 8 * sizeof(Features)) {
+        throw std::runtime_error("shader variants: too many features");
+    }
+}
+
+void ShaderVariants::request(Features features) {
+    if (_variants.count(features) != 0) {
+        return;
+    }
+
+    Variant& variant = _variants[features];
+    variant.program.reset(new GLSLProgram);
+    variant.program->attachVertexShader(specialize(_vsCode, features));
+    variant.program->attachFragmentShader(specialize(_fsCode, features));
+    variant.program->beginLink();
+}
+
+void ShaderVariants::finishRequests() {
+    std::vector<GLSLProgram*> pending;
+    for (auto& it : _variants) {
+        if (!it.second.linked) {
+            pending.push_back(it.second.program.get());
+        }
+    }
+    GLSLProgram::finishLinks(pending);
+
+    for (auto& it : _variants) {
+        if (!it.second.linked) {
+            finish(it.second, it.first);
+        }
+    }
+}
+
+GLSLProgram& ShaderVariants::get(Features features) {
+    request(features);
+
+    Variant& variant = _variants[features];
+    if (!variant.linked) {
+        variant.program->finishLink();
+        finish(variant, features);
+    }
+
+    return *variant.program;
+}
+
+size_t ShaderVariants::getVariantCount() const {
+    return _variants.size();
+}
+
+std::string ShaderVariants::getDefines(Features features) const {
+    std::string defines;
+    for (size_t i = 0; i < _featureNames.size(); ++i) {
+        if (features & (Features(1) << i)) {
+            defines += "#define " + _featureNames[i] + "\n";
+        }
+    }
+
+    return defines;
+}
+
+std::string ShaderVariants::specialize(const std::string& code, Features features) const {
+    // nothing but comments and whitespace may precede #version in glsl
+    if (code.compare(0, 8, "#version") != 0) {
+        throw std::runtime_error("shader variants: source must start with #version");
+    }
+
+    const size_t lineEnd = code.find('\n');
+    if (lineEnd == std::string::npos) {
+        return code + "\n" + getDefines(features);
+    }
+
+    return code.substr(0, lineEnd + 1) + getDefines(features) + code.substr(lineEnd + 1);
+}
+
+void ShaderVariants::finish(Variant& variant, Features features) {
+    variant.linked = true;
+    if (_setup) {
+        _setup(*variant.program, features);
+    }
+}
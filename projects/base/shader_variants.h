@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "glsl_program.h"
+
+// one uber shader specialised by a bitmask of features. bit i of a feature set defines
+// the i-th feature name as a macro right after the #version line, so the source
+// branches with #ifdef and each variant only pays for what it enables. variants are
+// linked the first time they are asked for and kept, the binary cache of GLSLProgram
+// makes the next start cheap
+class ShaderVariants {
+public:
+    using Features = uint32_t;
+
+    // runs once per variant after it linked, e.g. to bind the uniform blocks
+    using LinkSetup = std::function<void(GLSLProgram&, Features)>;
+
+    // both sources start with their #version line
+    ShaderVariants(
+        const std::string& vsCode, const std::string& fsCode,
+        const std::vector<std::string>& featureNames, LinkSetup setup = nullptr);
+
+    ShaderVariants(const ShaderVariants&) = delete;
+
+    ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+    // begins linking the variant without waiting, for variants known to be needed at load
+    // time. does nothing for a variant requested before
+    void request(Features features);
+
+    // finishes every variant requested so far
+    void finishRequests();
+
+    // the linked variant, blocks while it is compiled on first use
+    GLSLProgram& get(Features features);
+
+    size_t getVariantCount() const;
+
+    // the #define lines of the feature set
+    std::string getDefines(Features features) const;
+
+private:
+    struct Variant {
+        std::unique_ptr<GLSLProgram> program;
+        bool linked = false;
+    };
+
+    std::string _vsCode;
+    std::string _fsCode;
+    std::vector<std::string> _featureNames;
+    LinkSetup _setup;
+
+    std::unordered_map<Features, Variant> _variants;
+
+    std::string specialize(const std::string& code, Features features) const;
+
+    void finish(Variant& variant, Features features);
+};
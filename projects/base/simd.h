@@ -0,0 +1,13 @@
+#pragma once
+
+// instruction sets available to the batch kernels at compile time,
+// every kernel keeps a scalar path for the other targets (e.g. emscripten)
+#if defined(__AVX__)
+    #define CG_SIMD_AVX 1
+    #include <immintrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define CG_SIMD_SSE2 1
+    #include <emmintrin.h>
+#endif
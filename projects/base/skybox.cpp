@@ -1,3 +1,5 @@
+#include "frame_uniform_block.h"
+#include "gl_state_cache.h"
 #include "skybox.h"
 
 SkyBox::SkyBox(const std::vector<std::string>& textureFilenames) {
@@ -23,28 +25,27 @@ SkyBox::SkyBox(const std::vector<std::string>& textureFilenames) {
     glGenVertexArrays(1, &_vao);
     glGenBuffers(1, &_vbo);
 
-    glBindVertexArray(_vao);
-    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+    GLStateCache::instance().bindVertexArray(_vao);
+    GLStateCache::instance().bindBuffer(GL_ARRAY_BUFFER, _vbo);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), &vertices, GL_STATIC_DRAW);
 
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), 0);
 
-    glBindVertexArray(0);
+    GLStateCache::instance().bindVertexArray(0);
 
     try {
         // init texture
         _texture.reset(new ImageTextureCubemap(textureFilenames));
 
-        const char* vsCode =
-            "#version 330 core\n"
+        // the camera comes from the per frame block, translation removed from the view
+        const std::string vsCode =
+            std::string("#version 330 core\n") + FrameUniformBlock::getDeclaration() +
             "layout(location = 0) in vec3 aPosition;\n"
             "out vec3 texCoord;\n"
-            "uniform mat4 projection;\n"
-            "uniform mat4 view;\n"
             "void main() {\n"
             "   texCoord = aPosition;\n"
-            "   gl_Position = (projection * view * vec4(aPosition, 1.0f)).xyww;\n"
+            "   gl_Position = (projection * mat4(mat3(view)) * vec4(aPosition, 1.0f)).xyww;\n"
             "}\n";
 
         const char* fsCode =
@@ -59,7 +60,7 @@ SkyBox::SkyBox(const std::vector<std::string>& textureFilenames) {
         _shader.reset(new GLSLProgram);
         _shader->attachVertexShader(vsCode);
         _shader->attachFragmentShader(fsCode);
-        _shader->link();
+        _shader->beginLink();
     } catch (const std::exception&) {
         cleanup();
         throw;
@@ -85,32 +86,36 @@ SkyBox::~SkyBox() {
     cleanup();
 }
 
-void SkyBox::draw(const glm::mat4& projection, const glm::mat4& view) {
+void SkyBox::finishShader() {
+    _shader->finishLink();
+    _shader->setUniformBlockBinding(FrameUniformBlock::getName(), FrameUniformBlock::binding);
+}
+
+void SkyBox::draw() {
     // TODO:: draw skybox
     // write your code here
     // -----------------------------------------------
     // ...
     // -----------------------------------------------
-    glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
+    // change depth function so depth test passes when values are equal to depth buffer's content
+    GLStateCache::instance().depthFunc(GL_LEQUAL);
     _shader->use();
-    glm::mat4 review = glm::mat4(glm::mat3(view)); // remove translation from the view matrix
-    _shader->setUniformMat4("view", review);
-    _shader->setUniformMat4("projection", projection);
     // skybox cube
-    glBindVertexArray(_vao);
+    GLStateCache::instance().bindVertexArray(_vao);
     _texture->bind();
     glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
-    glDepthFunc(GL_LESS); // set depth function back to default
+    GLStateCache::instance().depthFunc(GL_LESS); // set depth function back to default
 
 }
 void SkyBox::cleanup() {
     if (_vbo != 0) {
+        GLStateCache::instance().forgetBuffer(_vbo);
         glDeleteBuffers(1, &_vbo);
         _vbo = 0;
     }
 
     if (_vao != 0) {
+        GLStateCache::instance().forgetVertexArray(_vao);
         glDeleteVertexArrays(1, &_vao);
         _vao = 0;
     }
@@ -12,13 +12,18 @@
 
 class SkyBox {
 public:
+    // the shader link is only begun here, call finishShader() before the first draw
     SkyBox(const std::vector<std::string>& textureFilenames);
 
     SkyBox(SkyBox&& rhs) noexcept;
 
     ~SkyBox();
 
-    void draw(const glm::mat4& projection, const glm::mat4& view);
+    // waits for the link begun by the constructor, throws like GLSLProgram::finishLink()
+    void finishShader();
+
+    // projection and view are read from the per frame uniform block
+    void draw();
 
 private:
     GLuint _vao = 0;
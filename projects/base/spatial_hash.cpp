@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <cmath>
+
+#include "spatial_hash.h"
+
+SpatialHash::SpatialHash(float cellSize) : _cellSize(cellSize) {}
+
+void SpatialHash::insert(uint64_t id, const BoundingBox& box) {
+    const int32_t x0 = toCell(box.min.x), x1 = toCell(box.max.x);
+    const int32_t z0 = toCell(box.min.z), z1 = toCell(box.max.z);
+    for (int32_t z = z0; z <= z1; ++z) {
+        for (int32_t x = x0; x <= x1; ++x) {
+            _cells[makeKey(x, z)].push_back(id);
+        }
+    }
+}
+
+void SpatialHash::remove(uint64_t id, const BoundingBox& box) {
+    const int32_t x0 = toCell(box.min.x), x1 = toCell(box.max.x);
+    const int32_t z0 = toCell(box.min.z), z1 = toCell(box.max.z);
+    for (int32_t z = z0; z <= z1; ++z) {
+        for (int32_t x = x0; x <= x1; ++x) {
+            auto iter = _cells.find(makeKey(x, z));
+            if (iter == _cells.end()) {
+                continue;
+            }
+
+            auto& ids = iter->second;
+            auto pos = std::find(ids.begin(), ids.end(), id);
+            if (pos != ids.end()) {
+                *pos = ids.back();
+                ids.pop_back();
+            }
+
+            // drop empty cells so memory follows the live entries
+            if (ids.empty()) {
+                _cells.erase(iter);
+            }
+        }
+    }
+}
+
+void SpatialHash::query(const BoundingBox& box, std::vector<uint64_t>& ids) const {
+    ids.clear();
+
+    const int32_t x0 = toCell(box.min.x), x1 = toCell(box.max.x);
+    const int32_t z0 = toCell(box.min.z), z1 = toCell(box.max.z);
+    for (int32_t z = z0; z <= z1; ++z) {
+        for (int32_t x = x0; x <= x1; ++x) {
+            auto iter = _cells.find(makeKey(x, z));
+            if (iter != _cells.end()) {
+                ids.insert(ids.end(), iter->second.begin(), iter->second.end());
+            }
+        }
+    }
+
+    // entries spanning several cells show up more than once
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+}
+
+float SpatialHash::getCellSize() const {
+    return _cellSize;
+}
+
+size_t SpatialHash::getCellCount() const {
+    return _cells.size();
+}
+
+void SpatialHash::clear() {
+    _cells.clear();
+}
+
+int32_t SpatialHash::toCell(float v) const {
+    return static_cast<int32_t>(std::floor(v / _cellSize));
+}
+
+uint64_t SpatialHash::makeKey(int32_t x, int32_t z) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(z);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "bounding_box.h"
+
+// uniform grid over the x-z plane stored in a hash map, so only occupied cells
+// cost memory. an entry is registered in every cell its box overlaps and a query
+// only visits the cells covered by the query box
+class SpatialHash {
+public:
+    SpatialHash(float cellSize);
+
+    void insert(uint64_t id, const BoundingBox& box);
+
+    // box must be the one the entry was inserted with
+    void remove(uint64_t id, const BoundingBox& box);
+
+    // ids of the entries sharing at least one cell with box, each reported once
+    void query(const BoundingBox& box, std::vector<uint64_t>& ids) const;
+
+    float getCellSize() const;
+
+    size_t getCellCount() const;
+
+    void clear();
+
+private:
+    float _cellSize;
+
+    std::unordered_map<uint64_t, std::vector<uint64_t>> _cells;
+
+    int32_t toCell(float v) const;
+
+    static uint64_t makeKey(int32_t x, int32_t z);
+};
@@ -1,11 +1,12 @@
 #include <cassert>
 #include <stb_image.h>
 
+#include "gl_state_cache.h"
 #include "texture_cubemap.h"
 
 TextureCubemap::TextureCubemap(
     GLint internalFormat, int width, int height, GLenum format, GLenum dataType) {
-    glBindTexture(GL_TEXTURE_CUBE_MAP, _handle);
+    GLStateCache::instance().bindTexture(GL_TEXTURE_CUBE_MAP, _handle);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
@@ -18,18 +19,17 @@ TextureCubemap::TextureCubemap(
             dataType, nullptr);
     }
 
-    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    GLStateCache::instance().bindTexture(GL_TEXTURE_CUBE_MAP, 0);
 }
 
 TextureCubemap::TextureCubemap(TextureCubemap&& rhs) noexcept : Texture(std::move(rhs)) {}
 
 void TextureCubemap::bind(int slot) const {
-    glActiveTexture(GL_TEXTURE0 + slot);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, _handle);
+    GLStateCache::instance().bindTexture(slot, GL_TEXTURE_CUBE_MAP, _handle);
 }
 
 void TextureCubemap::unbind() const {
-    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    GLStateCache::instance().bindTexture(GL_TEXTURE_CUBE_MAP, 0);
 }
 
 void TextureCubemap::generateMipmap() const {
@@ -46,7 +46,7 @@ ImageTextureCubemap::ImageTextureCubemap(const std::vector<std::string>& filepat
     // TODO: load six images and generate the texture cubemap
     // hint: you can refer to Texture2D(const std::string&) for image loading
     // write your code here
-    glBindTexture(GL_TEXTURE_CUBE_MAP, _handle);
+    GLStateCache::instance().bindTexture(GL_TEXTURE_CUBE_MAP, _handle);
 
     int width, height, channels;
     for (unsigned int i = 0; i < filepaths.size(); i++)
@@ -77,7 +77,7 @@ ImageTextureCubemap::ImageTextureCubemap(const std::vector<std::string>& filepat
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    GLStateCache::instance().bindTexture(GL_TEXTURE_CUBE_MAP, 0);
 }
 
 ImageTextureCubemap::ImageTextureCubemap(ImageTextureCubemap&& rhs) noexcept
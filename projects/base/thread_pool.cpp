@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <atomic>
+
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(size_t threadCount) {
+    _workers.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+        _workers.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _condition.notify_all();
+
+    for (auto& worker : _workers) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::getThreadCount() const {
+    return _workers.size();
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& body) {
+    if (count == 0) {
+        return;
+    }
+
+    // every participant pulls indices from a shared counter until the range is used up
+    auto next = std::make_shared<std::atomic<size_t>>(0);
+    auto run = [next, count, &body]() {
+        for (size_t i = (*next)++; i < count; i = (*next)++) {
+            body(i);
+        }
+    };
+
+    const size_t helpers = std::min(_workers.size(), count - 1);
+    std::vector<std::future<void>> done;
+    done.reserve(helpers);
+    for (size_t i = 0; i < helpers; ++i) {
+        done.push_back(submit(run));
+    }
+
+    std::exception_ptr error;
+    try {
+        run();
+    } catch (...) {
+        error = std::current_exception();
+        // stop handing out indices, the helpers finish the ones they hold
+        *next = count;
+    }
+
+    for (auto& future : done) {
+        try {
+            future.get();
+        } catch (...) {
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+size_t ThreadPool::getDefaultThreadCount() {
+#if defined(__EMSCRIPTEN__)
+    return 0;
+#else
+    const size_t hardwareThreads = std::thread::hardware_concurrency();
+    return hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+#endif
+}
+
+void ThreadPool::enqueue(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _tasks.push(std::move(task));
+    }
+    _condition.notify_one();
+}
+
+void ThreadPool::work() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _condition.wait(lock, [this]() { return _stopping || !_tasks.empty(); });
+            if (_tasks.empty()) {
+                return;
+            }
+            task = std::move(_tasks.front());
+            _tasks.pop();
+        }
+
+        task();
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// fixed set of worker threads fed from one task queue. with no workers (e.g. a build
+// without thread support) every task runs on the calling thread
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threadCount = getDefaultThreadCount());
+
+    ThreadPool(const ThreadPool&) = delete;
+
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // finishes the queued tasks before joining the workers
+    ~ThreadPool();
+
+    size_t getThreadCount() const;
+
+    // runs task on a worker, the future yields its result or rethrows its exception
+    template <typename Task>
+    auto submit(Task task) -> std::future<decltype(task())>;
+
+    // calls body(i) for every i in [0, count) on the workers and the calling thread,
+    // returns once all calls are done and rethrows the first exception. not to be
+    // called from a task of the same pool, whose workers may all be waiting then
+    void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+    // one worker per hardware thread besides the calling one
+    static size_t getDefaultThreadCount();
+
+private:
+    std::vector<std::thread> _workers;
+
+    std::queue<std::function<void()>> _tasks;
+
+    std::mutex _mutex;
+
+    std::condition_variable _condition;
+
+    bool _stopping = false;
+
+    void enqueue(std::function<void()> task);
+
+    void work();
+};
+
+template <typename Task>
+auto ThreadPool::submit(Task task) -> std::future<decltype(task())> {
+    using Result = decltype(task());
+    auto packaged = std::make_shared<std::packaged_task<Result()>>(std::move(task));
+    std::future<Result> future = packaged->get_future();
+    if (_workers.empty()) {
+        (*packaged)();
+    } else {
+        enqueue([packaged]() { (*packaged)(); });
+    }
+
+    return future;
+}
@@ -1,5 +1,11 @@
+#include <atomic>
+
 #include "transform.h"
 
+namespace {
+std::atomic<uint64_t> nextVersion{1};
+} // namespace
+
 void Transform::setFromTRS(const glm::mat4& trs) {
     // https://blog.csdn.net/hunter_wwq/article/details/21473519
     position = {trs[3][0], trs[3][1], trs[3][2]};
@@ -15,18 +21,64 @@ void Transform::lookAt(const glm::vec3& target, const glm::vec3& up) {
 }
 
 glm::vec3 Transform::getFront() const {
-    return rotation * getDefaultFront();
+    return getCache().front;
 }
 
 glm::vec3 Transform::getUp() const {
-    return rotation * getDefaultUp();
+    return getCache().up;
 }
 
 glm::vec3 Transform::getRight() const {
-    return rotation * getDefaultRight();
+    return getCache().right;
 }
 
 glm::mat4 Transform::getLocalMatrix() const {
-    return glm::translate(glm::mat4(1.0f), position) * glm::mat4_cast(rotation)
-           * glm::scale(glm::mat4(1.0f), scale);
-}
\ No newline at end of file
+    return getCache().localMatrix;
+}
+
+uint64_t Transform::getVersion() const {
+    return getCache().version;
+}
+
+const Transform::Cache& Transform::getCache() const {
+    if (_cache.version != 0 && _cache.position == position && _cache.rotation == rotation
+        && _cache.scale == scale) {
+        return _cache;
+    }
+
+    _cache.position = position;
+    _cache.rotation = rotation;
+    _cache.scale = scale;
+
+    // T * R * S written out: the rotation columns scaled, the position as last column
+    const glm::mat3 r = glm::mat3_cast(rotation);
+    _cache.localMatrix = glm::mat4(
+        glm::vec4(r[0] * scale.x, 0.0f), glm::vec4(r[1] * scale.y, 0.0f),
+        glm::vec4(r[2] * scale.z, 0.0f), glm::vec4(position, 1.0f));
+
+    // the rotated default axes are the columns of the rotation matrix
+    _cache.front = -r[2];
+    _cache.up = r[1];
+    _cache.right = r[0];
+
+    _cache.version = nextVersion++;
+
+    return _cache;
+}
+
+glm::mat3 computeNormalMatrix(const glm::mat4& model) {
+    const glm::mat3 m(model);
+
+    // uniform scale: columns of equal length and orthogonal to each other
+    const float xx = glm::dot(m[0], m[0]);
+    const float tolerance = 1e-4f * xx;
+    if (glm::abs(glm::dot(m[1], m[1]) - xx) <= tolerance &&
+        glm::abs(glm::dot(m[2], m[2]) - xx) <= tolerance &&
+        glm::abs(glm::dot(m[0], m[1])) <= tolerance &&
+        glm::abs(glm::dot(m[0], m[2])) <= tolerance &&
+        glm::abs(glm::dot(m[1], m[2])) <= tolerance) {
+        return m;
+    }
+
+    return glm::inverseTranspose(m);
+}
@@ -1,10 +1,14 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 
 #include <glm/ext.hpp>
 #include <glm/glm.hpp>
 
+// the getters rebuild a cache on the first query after a field changed, so even const
+// queries write to it: a transform must only be read and written from one thread at a
+// time. hand workers copies of the matrices or boxes derived from it
 struct Transform {
 public:
     glm::vec3 position = {0.0f, 0.0f, 0.0f};
@@ -24,6 +28,11 @@ public:
 
     glm::mat4 getLocalMatrix() const;
 
+    // changes whenever position, rotation or scale differ from the last query,
+    // state derived from the transform can be cached against it. versions are
+    // unique across all transforms, so a cache survives copying transforms around
+    uint64_t getVersion() const;
+
     static constexpr glm::vec3 getDefaultFront() {
         return {0.0f, 0.0f, -1.0f};
     }
@@ -35,4 +44,30 @@ public:
     static constexpr glm::vec3 getDefaultRight() {
         return {1.0f, 0.0f, 0.0f};
     }
-};
\ No newline at end of file
+
+private:
+    // the fields stay public, so the cache is validated by comparing them
+    // with the values it was built from instead of by setters
+    struct Cache {
+        glm::vec3 position;
+        glm::quat rotation;
+        glm::vec3 scale;
+
+        glm::mat4 localMatrix;
+        glm::vec3 front;
+        glm::vec3 up;
+        glm::vec3 right;
+
+        // 0 marks a cache that was never built
+        uint64_t version = 0;
+    };
+
+    mutable Cache _cache;
+
+    const Cache& getCache() const;
+};
+
+// inverse transpose of the upper 3x3 of model, which carries normals to world space.
+// a rotation with a uniform scale is its own normal matrix up to the length, and
+// normals are renormalized after interpolation, so no inverse is needed for it
+glm::mat3 computeNormalMatrix(const glm::mat4& model);
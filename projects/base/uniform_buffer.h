@@ -1,33 +1,36 @@
 #pragma once
 
+#include <cassert>
 #include <map>
 #include <string>
 
-#include "gl_utility.h"
+#include "gl_state_cache.h"
 
 class UniformBuffer {
 public:
-    UniformBuffer(size_t bufferSize, GLenum usage) {
+    UniformBuffer(size_t bufferSize, GLenum usage) : _size(bufferSize), _usage(usage) {
         glGenBuffers(1, &_handle);
-        glBindBuffer(GL_UNIFORM_BUFFER, _handle);
+        GLStateCache::instance().bindBuffer(GL_UNIFORM_BUFFER, _handle);
         glBufferData(GL_UNIFORM_BUFFER, bufferSize, nullptr, usage);
-        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        GLStateCache::instance().bindBuffer(GL_UNIFORM_BUFFER, 0);
     }
 
     UniformBuffer(UniformBuffer&& rhs) noexcept
-        : _handle(rhs._handle), _offsetMap(std::move(rhs._offsetMap)) {
+        : _handle(rhs._handle), _size(rhs._size), _usage(rhs._usage),
+          _offsetMap(std::move(rhs._offsetMap)) {
         rhs._handle = 0;
     }
 
     ~UniformBuffer() {
         if (_handle != 0) {
+            GLStateCache::instance().forgetBuffer(_handle);
             glDeleteBuffers(1, &_handle);
             _handle = 0;
         }
     }
 
     void setBindingPoint(uint32_t index) const {
-        glBindBufferBase(GL_UNIFORM_BUFFER, index, _handle);
+        GLStateCache::instance().bindBufferBase(GL_UNIFORM_BUFFER, index, _handle);
     }
 
     void setOffset(const std::string& name, size_t offset) {
@@ -42,13 +45,30 @@ public:
             return;
         }
 
-        glBindBuffer(GL_UNIFORM_BUFFER, _handle);
+        GLStateCache::instance().bindBuffer(GL_UNIFORM_BUFFER, _handle);
         glBufferSubData(GL_UNIFORM_BUFFER, iter->second, sizeof(T), &value);
-        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        GLStateCache::instance().bindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // replaces the whole buffer with a struct mirroring the std140 block, one call
+    // per frame instead of a lookup and a bind for every member. respecifying the
+    // storage lets the driver hand out fresh memory while the last frame still reads
+    // the old one
+    template <typename Block>
+    void upload(const Block& block) const {
+        static_assert(sizeof(Block) % 16 == 0, "std140 blocks are padded to 16 bytes");
+        assert(sizeof(Block) <= _size);
+
+        GLStateCache::instance().bindBuffer(GL_UNIFORM_BUFFER, _handle);
+        glBufferData(GL_UNIFORM_BUFFER, _size, nullptr, _usage);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Block), &block);
+        GLStateCache::instance().bindBuffer(GL_UNIFORM_BUFFER, 0);
     }
 
 private:
     GLuint _handle{};
+    size_t _size = 0;
+    GLenum _usage = GL_DYNAMIC_DRAW;
     std::map<std::string, size_t> _offsetMap;
 };
 
@@ -61,7 +81,7 @@ inline void UniformBuffer::update<bool>(const std::string& name, const bool& val
     }
 
     int intVal = static_cast<int>(value);
-    glBindBuffer(GL_UNIFORM_BUFFER, _handle);
+    GLStateCache::instance().bindBuffer(GL_UNIFORM_BUFFER, _handle);
     glBufferSubData(GL_UNIFORM_BUFFER, iter->second, sizeof(int), &intVal);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    GLStateCache::instance().bindBuffer(GL_UNIFORM_BUFFER, 0);
 }
\ No newline at end of file
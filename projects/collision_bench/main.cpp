@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "../base/collider_batch.h"
+
+// throughput of the character-vs-obstacle narrowphase, simd kernel against the
+// scalar reference, on obstacle fields laid out like the surfer track
+
+namespace {
+
+BoundingBox makeBox(const glm::vec3& center, const glm::vec3& halfExtent) {
+    BoundingBox box;
+    box.min = center - halfExtent;
+    box.max = center + halfExtent;
+    return box;
+}
+
+void fillTrack(ColliderBatch& batch, size_t count, std::mt19937& gen) {
+    std::uniform_real_distribution<float> distX(-8.0f, 8.0f);
+    std::uniform_real_distribution<float> distLength(0.5f, 2.5f);
+    std::uniform_int_distribution<int> shape(0, 5);
+
+    // six obstacles every ten units along -z
+    const float depth = 10.0f * static_cast<float>(count) / 6.0f;
+    std::uniform_real_distribution<float> distZ(-depth, 0.0f);
+
+    for (size_t i = 0; i < count; ++i) {
+        const glm::vec3 center(distX(gen), 0.6f, distZ(gen));
+        if (shape(gen) == 1) {
+            batch.pushSphere(center, 0.6f);
+        } else {
+            batch.pushBox(makeBox(center, glm::vec3(distLength(gen), 0.6f, 0.5f)));
+        }
+    }
+}
+
+std::vector<BoundingBox> makeQueries(size_t count, float depth, float y, std::mt19937& gen) {
+    std::uniform_real_distribution<float> distX(-5.0f, 5.0f);
+    std::uniform_real_distribution<float> distZ(-depth, 0.0f);
+
+    std::vector<BoundingBox> queries;
+    queries.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        const glm::vec3 center(distX(gen), y, distZ(gen));
+        queries.push_back(makeBox(center, glm::vec3(0.3f, 0.9f, 0.3f)));
+    }
+
+    return queries;
+}
+
+template <typename Kernel>
+double measure(const std::vector<BoundingBox>& queries, int repeats, Kernel kernel, size_t& hits) {
+    hits = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < repeats; ++r) {
+        for (const auto& query : queries) {
+            hits += kernel(query) ? 1 : 0;
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    return std::chrono::duration<double>(end - start).count();
+}
+
+} // namespace
+
+int main() {
+    const size_t obstacleCounts[] = {10, 1000, 100000};
+
+    std::printf("%10s %14s %14s %8s\n", "obstacles", "simd (M/s)", "scalar (M/s)", "speedup");
+
+    for (size_t count : obstacleCounts) {
+        std::mt19937 gen(20240101u + static_cast<unsigned>(count));
+
+        ColliderBatch batch;
+        fillTrack(batch, count, gen);
+        const float depth = 10.0f * static_cast<float>(count) / 6.0f;
+
+        // results must match the reference on queries that do hit
+        const std::vector<BoundingBox> probes = makeQueries(4096, depth, 0.9f, gen);
+        for (const auto& probe : probes) {
+            if (batch.intersects(probe) != batch.intersectsScalar(probe, 0, batch.size())) {
+                std::fprintf(stderr, "simd and scalar results differ at %zu obstacles\n", count);
+                return EXIT_FAILURE;
+            }
+        }
+
+        // queries above every obstacle never exit early, so each one scans the whole batch
+        const std::vector<BoundingBox> queries = makeQueries(64, depth, 10.0f, gen);
+        const int repeats = static_cast<int>(std::max<size_t>(1, 20000000 / (count * 64)));
+        const double tested = static_cast<double>(count) * queries.size() * repeats;
+
+        size_t simdHits = 0, scalarHits = 0;
+        const double simdTime = measure(
+            queries, repeats, [&](const BoundingBox& query) { return batch.intersects(query); },
+            simdHits);
+        const double scalarTime = measure(
+            queries, repeats,
+            [&](const BoundingBox& query) { return batch.intersectsScalar(query, 0, batch.size()); },
+            scalarHits);
+
+        std::printf(
+            "%10zu %14.1f %14.1f %7.2fx\n", count, tested / simdTime * 1e-6,
+            tested / scalarTime * 1e-6, scalarTime / simdTime);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -4,29 +4,88 @@
 
 #include <random>
 #include <algorithm>
+#include <chrono>
+#include <limits>
 
 #include "../base/transform.h"
 #include "game.h"
-#include "ground.h"
+#include "track_terrain.h"
 //#include "obstacle.h"
 
 const std::string modelRelPath = "obj/villager.obj";
 
+// simplified levels of the loaded model, each with half the triangles of the one before
+const size_t modelLodCount = 4;
+
 const std::string earthTextureRelPath = "texture/miscellaneous/earthmap.jpg";
 const std::string planetTextureRelPath = "texture/miscellaneous/planet_Quom1200.png";
 
 const std::string groundTextureRelPath = "texture/ground/final1.jpg";
 
+// the ground texture repeats every tile
+const float groundTileWidth = 20.0f;
+const float groundTileLength = 10.0f;
+
+// terrain chunks of terrainQuads x terrainQuads cells reach terrainAhead in front of the
+// camera and terrainBehind past it, behind every shadow cascade as well. shadows draw every
+// chunk at one level, so the cached depth does not change with the camera
+const float terrainChunkSize = 32.0f;
+const int terrainQuads = 32;
+const int terrainLevels = 4;
+const int terrainColumns = 6;
+const float terrainAhead = 320.0f;
+const float terrainBehind = 40.0f;
+const int terrainShadowLevel = 1;
+
+// level of detail of the obstacles in the shadow maps, a shadow hides the tessellation
+const size_t obstacleShadowLod = 1;
+
+// resolution of the cpu depth buffer and the occluders rendered into it
+const int occlusionBufferWidth = 256;
+const int occlusionBufferHeight = 128;
+const size_t maxOccluders = 16; //nearest obstacles in view
+const size_t maxOccluderFaces = 512; //finer meshes cost more than they hide
+
+// clustered lighting: screen tiles, depth slices up to the depth lamps are lit to, and the
+// texture units of the light buffer and the cluster lists
+const int clusterTilesX = 16;
+const int clusterTilesY = 9;
+const int clusterSlices = 24;
+const float clusterMaxDepth = 150.0f;
+const GLuint clusterLightUnit = 1;
+const GLuint clusterListUnit = 2;
+
+// shadows of the directional light up to shadowDistance, sampled from shadowMapUnit
+const int shadowResolution = 1024;
+const int shadowCascadeCount = 3;
+const float shadowDistance = 60.0f;
+const GLuint shadowMapUnit = 3;
+
+// track lamps fill this distance ahead of the camera in rows across the track
+const float trackLightDistance = 100.0f;
+const int trackLightsPerRow = 4;
+
 const std::vector<std::string> skyboxTextureRelPaths = {
     "texture/skybox/Right_Tex.jpg", "texture/skybox/Left_Tex.jpg",  "texture/skybox/Up_Tex.jpg",
     "texture/skybox/Down_Tex.jpg",  "texture/skybox/Front_Tex.jpg", "texture/skybox/Back_Tex.jpg"};
 
 Game::Game(const Options& options) : Application(options) {
-
+    // startup: the shader compiles are submitted first and run on the driver's compiler
+    // threads while the models and textures load, then they are collected
+    const auto startupBegin = std::chrono::steady_clock::now();
+    initSceneShaders();
     initModelResources(); //all the light,sky and character
-    // init shaders
-    initTextureShader();
-    initPhongShader();
+    finishShaders();
+    GLSLProgram::prewarm(); //the frame uniform buffer is bound by now
+    initRenderQueue();
+
+    const std::chrono::duration<double, std::milli> startupTime =
+        std::chrono::steady_clock::now() - startupBegin;
+    std::cout << "shaders and assets ready in " << startupTime.count() << " ms (parallel compile: "
+              << (GLSLProgram::isParallelCompileSupported() ? "on" : "off")
+              << ", program binary cache: "
+              << (_sceneShaders->get(SceneFeature::Texture).isLinkedFromCache() ? "hit" : "miss")
+              << ")" << std::endl;
 
     // init imGUI
     IMGUI_CHECKVERSION();
@@ -42,6 +101,16 @@ void Game::initModelResources(){
     // init model
     if(_character==nullptr){
         _character.reset(new Model(getAssetFullPath(modelRelPath)));
+        const auto lodStart = std::chrono::steady_clock::now();
+        _character->generateLods(modelLodCount);
+        const std::chrono::duration<double, std::milli> lodTime =
+            std::chrono::steady_clock::now() - lodStart;
+        std::cout << modelRelPath << ": " << _character->getLodCount() << " levels of detail in "
+                  << lodTime.count() << " ms" << std::endl;
+        const MeshOptimizer::Report& meshReport = _character->getMeshReport();
+        std::cout << modelRelPath << ": vertex cache acmr " << meshReport.before.acmr << " -> "
+                  << meshReport.after.acmr << ", atvr " << meshReport.before.atvr << " -> "
+                  << meshReport.after.atvr << std::endl;
         //testOn(); //test obj loader
         float angle = glm::radians(-90.0f);
         glm::quat rotation_more = glm::angleAxis(angle, glm::vec3(0.0f, 1.0f, 0.0f));
@@ -50,19 +119,43 @@ void Game::initModelResources(){
     float height = _character->getBoundingBox().min.y; //get the height of the character
     _character->transform.position = glm::vec3(0.0,-height,5.0); //move to exactly the ground
     //init ground
-    _ground.reset(new Ground(20.0,10.0)); //long enough
     _groundTexture.reset(new ImageTexture2D(getAssetFullPath(groundTextureRelPath)));
     _groundTexture->bind();
+    // the terrain is seen far down the track, where the tiles shrink below a texel
+    _groundTexture->generateMipmap();
+    _groundTexture->setParamterInt(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     
-    Transform new_transform;
-    _groundTransforms.clear();
-    _groundTransforms.push_back(new_transform);
-    new_transform.position.z -= 10;
-    _groundTransforms.push_back(new_transform);
-    new_transform.position.z -= 10;
-    _groundTransforms.push_back(new_transform);
-    
+    if (_meshLibrary == nullptr) {
+        _meshLibrary.reset(new MeshLibrary);
+    }
     _obstacles.clear();
+    _obstacleGrid.clear();
+    _obstacleColliders.clear();
+    if (_occlusionCuller == nullptr) {
+        _occlusionCuller.reset(new OcclusionCuller);
+    }
+    if (_threadPool == nullptr) {
+        _threadPool.reset(new ThreadPool);
+    }
+    if (_lightClusters == nullptr) {
+        _lightClusters.reset(new LightClusters(
+            clusterTilesX, clusterTilesY, clusterSlices, _threadPool.get()));
+    }
+    if (_shadowMap == nullptr) {
+        _shadowMap.reset(
+            new CascadedShadowMap(shadowResolution, shadowCascadeCount, shadowDistance));
+    } else {
+        _shadowMap->invalidate(); //the whole scene was rebuilt
+    }
+    if (_opaqueTimer == nullptr) {
+        _opaqueTimer.reset(new GpuTimer);
+        _depthPrePassTimer.reset(new GpuTimer);
+    }
+    if (_occlusionRasterizer == nullptr) {
+        _occlusionRasterizer.reset(new OcclusionRasterizer(
+            occlusionBufferWidth, occlusionBufferHeight, _threadPool.get()));
+    }
+    _occlusionCuller->clear();
     initObstacles();
 
     // init textures
@@ -94,6 +187,15 @@ void Game::initModelResources(){
     }
     _camera->transform.position = glm::vec3(0.0,3.0,12.0);
 
+    // the chunks around the start are there before the first frame
+    if (_terrain == nullptr) {
+        _terrain.reset(new ChunkedTerrain(
+            terrainChunkSize, terrainQuads, terrainLevels, terrainColumns, getTrackTerrainHeight,
+            _threadPool.get()));
+    }
+    _terrain->update(_camera->transform.position, terrainAhead, terrainBehind);
+    _terrain->finishPending();
+
     // init lights
     _ambientLight.reset(new AmbientLight);
     _ambientLight->intensity = 1.0;
@@ -114,69 +216,55 @@ Game::~Game() {
     ImGui::DestroyContext();
 }
 
-void Game::initTextureShader() {
-    const char* vsCode =
-        "#version 330 core\n"
-        "layout(location = 0) in vec3 aPosition;\n"
-        "layout(location = 1) in vec3 aNormal;\n"
-        "layout(location = 2) in vec2 aTexCoord;\n"
-        "out vec2 fTexCoord;\n"
-        "uniform mat4 projection;\n"
-        "uniform mat4 view;\n"
-        "uniform mat4 model;\n"
-
-        "void main() {\n"
-        "    fTexCoord = aTexCoord;\n"
-        "    gl_Position = projection * view * model * vec4(aPosition, 1.0f);\n"
-        "}\n";
+void Game::initSceneShaders() {
+    const std::string frameBlock = FrameUniformBlock::getDeclaration();
 
-    const char* fsCode =
-        "#version 330 core\n"
-        "in vec2 fTexCoord;\n"
-        "out vec4 color;\n"
-        "struct AmbientLight {\n"
-        "    vec3 color;\n"
-        "    float intensity;\n"
-        "};\n"
-
-        "uniform sampler2D mapKd;\n"
-        "uniform AmbientLight ambientLight;\n"
-
-        "void main() {\n"
-        "    vec3 result = ambientLight.color* ambientLight.intensity* texture(mapKd, fTexCoord).rgb;\n"
-        "    color = vec4(result,1.0f);\n"
-        "}\n";
-
-    _textureShader.reset(new GLSLProgram);
-    _textureShader->attachVertexShader(vsCode);
-    _textureShader->attachFragmentShader(fsCode);
-    _textureShader->link();
-}
-void Game::initPhongShader() {
-    const char* vsCode =
-        "#version 330 core\n"
+    const std::string vsCode =
+        "#version 330 core\n" + frameBlock +
         "layout(location = 0) in vec3 aPosition;\n"
         "layout(location = 1) in vec3 aNormal;\n"
         "layout(location = 2) in vec2 aTexCoord;\n"
+        "#ifdef INSTANCED\n"
+        "layout(location = 3) in mat4 aInstanceMatrix;\n"
+        "layout(location = 7) in mat3 aInstanceNormalMatrix;\n"
+        "#else\n"
+        "uniform mat4 model;\n"
+        "uniform mat3 normalMatrix;\n"
+        "#endif\n"
 
         "out vec3 fPosition;\n"
         "out vec3 fNormal;\n"
-
-        "uniform mat4 model;\n"
-        "uniform mat4 view;\n"
-        "uniform mat4 projection;\n"
-        
+        "out vec2 fTexCoord;\n"
+        "// the depth pre-pass runs this same code, its depth must match to the last bit\n"
+        "invariant gl_Position;\n"
 
         "void main() {\n"
-        "    fPosition = vec3(model * vec4(aPosition, 1.0f));\n"
-        "    fNormal = mat3(transpose(inverse(model))) * aNormal;\n"
-        "    gl_Position = projection * view * model * vec4(aPosition, 1.0f);\n"
+        "#ifdef INSTANCED\n"
+        "    mat4 modelMatrix = aInstanceMatrix;\n"
+        "    mat3 modelNormalMatrix = aInstanceNormalMatrix;\n"
+        "#else\n"
+        "    mat4 modelMatrix = model;\n"
+        "    mat3 modelNormalMatrix = normalMatrix;\n"
+        "#endif\n"
+        "#ifdef INVERSE_IN_SHADER\n"
+        "    modelNormalMatrix = mat3(transpose(inverse(modelMatrix)));\n"
+        "#endif\n"
+        "    fPosition = vec3(modelMatrix * vec4(aPosition, 1.0f));\n"
+        "    fNormal = modelNormalMatrix * aNormal;\n"
+        "#ifdef WORLD_UV\n"
+        "    fTexCoord = fPosition.xz / vec2(" + std::to_string(groundTileWidth) + ", " +
+        std::to_string(groundTileLength) + ") + 0.5f;\n"
+        "#else\n"
+        "    fTexCoord = aTexCoord;\n"
+        "#endif\n"
+        "    gl_Position = projection * view * vec4(fPosition, 1.0f);\n"
         "}\n";
 
-    const char* fsCode =
-        "#version 330 core\n"
+    const std::string fsCode =
+        "#version 330 core\n" + frameBlock +
         "in vec3 fPosition;\n"
         "in vec3 fNormal;\n"
+        "in vec2 fTexCoord;\n"
         "out vec4 color;\n"
 
         "// material data structure declaration\n"
@@ -186,78 +274,216 @@ void Game::initPhongShader() {
         "    vec3 ks;\n"
         "    float ns;\n"
         "};\n"
-        "// ambient light data structure declaration\n"
-        "struct AmbientLight {\n"
-        "    vec3 color;\n"
-        "    float intensity;\n"
-        "};\n"
-        "// directional light data structure declaration\n"
-        "struct DirectionalLight {\n"
-        "    vec3 direction;\n"
-        "    float intensity;\n"
-        "    vec3 color;\n"
-        "};\n"
-
-        "// spot light data structure declaration\n"
-        "struct SpotLight {\n"
-        "    vec3 position;\n"
-        "    vec3 direction;\n"
-        "    float intensity;\n"
-        "    vec3 color;\n"
-        "    float angle;\n"
-        "    float kc;\n"
-        "    float kl;\n"
-        "    float kq;\n"
-        "};\n"
 
         "// uniform variables\n"
         "uniform Material material;\n"
-        "uniform DirectionalLight directionalLight;\n"
-        "uniform SpotLight spotLight;\n"
-        "uniform AmbientLight ambientLight;\n"
-        "uniform vec3 viewPos;\n"
-
-        "vec3 calcDirectionalLight(vec3 normal,vec3 viewDir) {\n"
-        "    vec3 lightDir = normalize(-directionalLight.direction);\n"
-        "    //vec3 ambient = material.ka * directionalLight.color;\n"
-        "    vec3 diffuse = directionalLight.color * max(dot(lightDir, normal), 0.0f) * "
-        "material.kd;\n"
+        "#ifdef TEXTURE\n"
+        "uniform sampler2D mapKd;\n"
+        "#endif\n"
+        "#ifdef CLUSTERED_LIGHTS\n"
+        "uniform samplerBuffer clusterLights;\n"
+        "uniform usamplerBuffer clusterLists;\n"
+        "#endif\n"
+        "#ifdef SHADOWS\n"
+        "uniform sampler2DArrayShadow shadowMap;\n"
+        "#endif\n"
+
+        "vec3 calcPhong(vec3 lightDir, vec3 lightColor, vec3 normal, vec3 viewDir, vec3 kd) {\n"
+        "    vec3 result = lightColor * max(dot(lightDir, normal), 0.0f) * kd;\n"
+        "#ifdef SPECULAR\n"
         "    vec3 reflectDir = reflect(-lightDir, normal);\n"
-        "    vec3 specular = directionalLight.color * pow(max(dot(viewDir, reflectDir), 0.0),material.ns) *"
+        "    result += lightColor * pow(max(dot(viewDir, reflectDir), 0.0), material.ns) * "
         "material.ks;\n"
-        "    return directionalLight.intensity * (diffuse+specular);\n"
+        "#endif\n"
+        "    return result;\n"
+        "}\n"
+
+        "#ifdef SHADOWS\n"
+        "float calcShadow(vec3 normal) {\n"
+        "    float depth = -(view * vec4(fPosition, 1.0f)).z;\n"
+        "    for (int i = 0; i < 4; ++i) {\n"
+        "        if (depth < shadows.splits[i]) {\n"
+        "            // offset along the normal by a texel or so against acne\n"
+        "            vec3 position = fPosition + normal * (1.5f * shadows.texelSizes[i]);\n"
+        "            vec4 clip = shadows.matrices[i] * vec4(position, 1.0f);\n"
+        "            vec3 coord = clip.xyz / clip.w * 0.5f + 0.5f;\n"
+        "            vec2 texel = 0.5f / vec2(textureSize(shadowMap, 0).xy);\n"
+        "            float lit = 0.0f;\n"
+        "            for (int x = -1; x <= 1; x += 2) {\n"
+        "                for (int y = -1; y <= 1; y += 2) {\n"
+        "                    lit += texture(shadowMap, vec4(coord.xy + vec2(x, y) * texel, "
+        "float(i), coord.z));\n"
+        "                }\n"
+        "            }\n"
+        "            return 0.25f * lit;\n"
+        "        }\n"
+        "    }\n"
+        "    return 1.0f;\n"
         "}\n"
+        "#endif\n"
 
-        "vec3 calcSpotLight(vec3 normal,vec3 viewDir) {\n"
+        "#ifdef DIRECTIONAL_LIGHT\n"
+        "vec3 calcDirectionalLight(vec3 normal, vec3 viewDir, vec3 kd) {\n"
+        "    vec3 lightDir = normalize(-directionalLight.direction);\n"
+        "    float intensity = directionalLight.intensity;\n"
+        "#ifdef SHADOWS\n"
+        "    intensity *= calcShadow(normal);\n"
+        "#endif\n"
+        "    return intensity * calcPhong(lightDir, directionalLight.color, normal, viewDir, kd);\n"
+        "}\n"
+        "#endif\n"
+
+        "#ifdef SPOT_LIGHT\n"
+        "vec3 calcSpotLight(vec3 normal, vec3 viewDir, vec3 kd) {\n"
         "    vec3 lightDir = normalize(spotLight.position - fPosition);\n"
         "    float theta = acos(-dot(lightDir, normalize(spotLight.direction)));\n"
         "    if (theta > spotLight.angle) {\n"
         "        return vec3(0.0f, 0.0f, 0.0f);\n"
         "    }\n"
-        "    //vec3 ambient = material.ka * spotLight.color;\n"
-        "    vec3 diffuse = spotLight.color * max(dot(lightDir, normal), 0.0f) * material.kd;\n"
-        "    vec3 reflectDir = reflect(-lightDir, normal);\n"
-        "    vec3 specular = spotLight.color * pow(max(dot(viewDir, reflectDir), 0.0),material.ns) *"
-        "material.ks;\n"
         "    float distance = length(spotLight.position - fPosition);\n"
         "    float attenuation = 1.0f / (spotLight.kc + spotLight.kl * distance + spotLight.kq * "
         "distance * distance);\n"
-        "    return spotLight.intensity * attenuation * (diffuse+specular);\n"
+        "    return spotLight.intensity * attenuation * "
+        "calcPhong(lightDir, spotLight.color, normal, viewDir, kd);\n"
+        "}\n"
+        "#endif\n"
+
+        "#ifdef CLUSTERED_LIGHTS\n"
+        "vec3 calcClusteredLights(vec3 normal, vec3 viewDir, vec3 kd) {\n"
+        "    float depth = -(view * vec4(fPosition, 1.0f)).z;\n"
+        "    int slice = max(int(log(depth) * clusters.scale.z + clusters.scale.w), 0);\n"
+        "    if (slice >= int(clusters.size.z)) {\n"
+        "        return vec3(0.0f, 0.0f, 0.0f);\n"
+        "    }\n"
+        "    ivec2 tile = min(ivec2(gl_FragCoord.xy * clusters.scale.xy), "
+        "ivec2(clusters.size.xy) - 1);\n"
+        "    int cluster = tile.x + int(clusters.size.x) * (tile.y + int(clusters.size.y) * "
+        "slice);\n"
+        "    int first = int(texelFetch(clusterLists, 2 * cluster).r);\n"
+        "    int last = first + int(texelFetch(clusterLists, 2 * cluster + 1).r);\n"
+        "    vec3 result = vec3(0.0f, 0.0f, 0.0f);\n"
+        "    for (int i = first; i < last; ++i) {\n"
+        "        int light = 4 * int(texelFetch(clusterLists, i).r);\n"
+        "        vec4 positionRange = texelFetch(clusterLights, light);\n"
+        "        vec4 colorCutoff = texelFetch(clusterLights, light + 1);\n"
+        "        vec4 directionKc = texelFetch(clusterLights, light + 2);\n"
+        "        vec2 klKq = texelFetch(clusterLights, light + 3).xy;\n"
+        "        vec3 toLight = positionRange.xyz - fPosition;\n"
+        "        float distance = length(toLight);\n"
+        "        vec3 lightDir = toLight / distance;\n"
+        "        if (distance > positionRange.w || -dot(lightDir, directionKc.xyz) < "
+        "colorCutoff.w) {\n"
+        "            continue;\n"
+        "        }\n"
+        "        // fades to zero at the range the light was binned with\n"
+        "        float window = clamp(1.0f - pow(distance / positionRange.w, 4.0f), 0.0f, 1.0f);\n"
+        "        float attenuation = window * window / (directionKc.w + klKq.x * distance + "
+        "klKq.y * distance * distance);\n"
+        "        result += attenuation * "
+        "calcPhong(lightDir, colorCutoff.rgb, normal, viewDir, kd);\n"
+        "    }\n"
+        "    return result;\n"
         "}\n"
+        "#endif\n"
 
         "void main() {\n"
+        "#ifdef TEXTURE\n"
+        "    vec3 ka = texture(mapKd, fTexCoord).rgb;\n"
+        "    vec3 kd = ka;\n"
+        "#else\n"
+        "    vec3 ka = material.ka;\n"
+        "    vec3 kd = material.kd;\n"
+        "#endif\n"
+        "    vec3 total = ambientLight.color * ambientLight.intensity * ka;\n"
+        "#if defined(DIRECTIONAL_LIGHT) || defined(SPOT_LIGHT) || defined(CLUSTERED_LIGHTS)\n"
         "    vec3 normal = normalize(fNormal);\n"
-        "    vec3 viewDir = normalize(viewPos - fPosition);"
-        "    vec3 total = calcDirectionalLight(normal,viewDir) + calcSpotLight(normal,viewDir) + "
-        "ambientLight.color *ambientLight.intensity *material.ka;\n"
+        "    vec3 viewDir = normalize(viewPos - fPosition);\n"
+        "#endif\n"
+        "#ifdef DIRECTIONAL_LIGHT\n"
+        "    total += calcDirectionalLight(normal, viewDir, kd);\n"
+        "#endif\n"
+        "#ifdef SPOT_LIGHT\n"
+        "    total += calcSpotLight(normal, viewDir, kd);\n"
+        "#endif\n"
+        "#ifdef CLUSTERED_LIGHTS\n"
+        "    total += calcClusteredLights(normal, viewDir, kd);\n"
+        "#endif\n"
         "    color = vec4(total, 1.0f);\n"
         "}\n";
     // ------------------------------------------------------------
 
-    _usualShader.reset(new GLSLProgram);
-    _usualShader->attachVertexShader(vsCode);
-    _usualShader->attachFragmentShader(fsCode);
-    _usualShader->link();
+    const std::vector<std::string> featureNames = {
+        "TEXTURE",           "DIRECTIONAL_LIGHT", "SPOT_LIGHT", "SPECULAR", "INSTANCED",
+        "INVERSE_IN_SHADER", "CLUSTERED_LIGHTS",  "SHADOWS",    "WORLD_UV"};
+    const ShaderVariants::LinkSetup setup = [](GLSLProgram& shader, ShaderVariants::Features) {
+        shader.setUniformBlockBinding(FrameUniformBlock::getName(), FrameUniformBlock::binding);
+        shader.use();
+        shader.setUniform(
+            shader.getUniformHandle<int>("clusterLights"), static_cast<int>(clusterLightUnit));
+        shader.setUniform(
+            shader.getUniformHandle<int>("clusterLists"), static_cast<int>(clusterListUnit));
+        shader.setUniform(
+            shader.getUniformHandle<int>("shadowMap"), static_cast<int>(shadowMapUnit));
+    };
+    _sceneShaders.reset(new ShaderVariants(vsCode, fsCode, featureNames, setup));
+    _sceneShaderSlots.clear();
+
+    // the depth pre-pass: the vertex stage of the scene shader, writing depth only
+    const std::string depthFsCode =
+        "#version 330 core\n"
+        "void main() {\n"
+        "}\n";
+    _depthShaders.reset(new ShaderVariants(vsCode, depthFsCode, featureNames, setup));
+    _depthShaders->request(0);
+    _depthShaders->request(SceneFeature::Instanced);
+
+    // the ground, and the character and obstacles under the initial lights
+    const ShaderVariants::Features lit =
+        SceneFeature::DirectionalLight | SceneFeature::SpotLight | SceneFeature::Specular |
+        SceneFeature::ClusteredLights | SceneFeature::Shadows;
+    _sceneShaders->request(
+        SceneFeature::Texture | SceneFeature::WorldUv | SceneFeature::DirectionalLight |
+        SceneFeature::ClusteredLights | SceneFeature::Shadows);
+    _sceneShaders->request(lit);
+    _sceneShaders->request(lit | SceneFeature::Instanced);
+
+    const std::string shadowVsCode =
+        "#version 330 core\n"
+        "layout(location = 0) in vec3 aPosition;\n"
+        "uniform mat4 lightViewProjection;\n"
+        "uniform mat4 model;\n"
+        "void main() {\n"
+        "    gl_Position = lightViewProjection * model * vec4(aPosition, 1.0f);\n"
+        "}\n";
+
+    const std::string shadowFsCode =
+        "#version 330 core\n"
+        "void main() {\n"
+        "}\n";
+
+    _shadowShader.reset(new GLSLProgram);
+    _shadowShader->attachVertexShader(shadowVsCode);
+    _shadowShader->attachFragmentShader(shadowFsCode);
+    _shadowShader->beginLink();
+}
+void Game::initRenderQueue() {
+    // scene shader variants are registered by getSceneShaderId() when first drawn
+    _renderQueue.setDepthShaders(
+        &_depthShaders->get(0), &_depthShaders->get(SceneFeature::Instanced));
+    _groundMaterialId = _renderQueue.registerMaterial([this](GLSLProgram&) {
+        _groundTexture->bind(0);
+    });
+}
+void Game::finishShaders() {
+    _sceneShaders->finishRequests();
+    _depthShaders->finishRequests();
+    _shadowShader->finishLink();
+    _skybox->finishShader();
+    _shadowModel = _shadowShader->getUniformHandle<glm::mat4>("model");
+    _shadowViewProjection = _shadowShader->getUniformHandle<glm::mat4>("lightViewProjection");
+
+    _frameUniformBuffer.reset(new UniformBuffer(sizeof(FrameUniformBlock), GL_DYNAMIC_DRAW));
+    _frameUniformBuffer->setBindingPoint(FrameUniformBlock::binding);
 }
 void Game::update(){
     float challenge = 0.001f;
@@ -291,21 +517,13 @@ void Game::update(){
     }
     //extend the scenes and destroy objects automatically
     float camera_pos = _camera->transform.position.z;
-    for (auto it = _obstacles.begin(); it != _obstacles.end();) {
-        if (it->transform.position.z >= camera_pos) {
-            it = _obstacles.erase(it);
-        }else {
-            ++it;  //to prohibit invalid iterators
-        }
-    }
-
-    if(_groundTransforms.front().position.z > camera_pos){
-        _groundTransforms.pop_front();
-        Transform new_trans = _groundTransforms.back();
-        new_trans.position.z -= 10;
-        _groundTransforms.push_back(new_trans);
-    }
-
+    //passed obstacles are at the near end
+    _obstacles.popNear(camera_pos, [this](const Obstacle& obstacle) {
+        _obstacleGrid.remove(obstacle._id, obstacle.getWorldBoundingBox());
+        _shadowMap->invalidate(obstacle.getWorldBoundingBox());
+        _obstacleColliders.popFront();
+        _occlusionCuller->remove(obstacle._id);
+    });
 
     const float far_view = 10.0f;
     if(_moveForward >= far_view){
@@ -401,79 +619,194 @@ void Game::renderFrame() {
 
     glClearColor(_clearColor.r, _clearColor.g, _clearColor.b, _clearColor.a);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glEnable(GL_DEPTH_TEST);
+    GLStateCache::instance().setEnabled(GL_DEPTH_TEST, true);
+
+    // lights and shadows first, the shadow pass leaves the polygon mode filled
+    streamTerrain();
+    updateTrackLights();
+    selectCharacterLod();
+    if (_shadows) {
+        renderShadows();
+    }
 
     if (wireframe) {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+        GLStateCache::instance().polygonMode(GL_LINE);
     } else {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        GLStateCache::instance().polygonMode(GL_FILL);
     }
 
     const glm::mat4 projection = _camera->getProjectionMatrix();
     const glm::mat4 view = _camera->getViewMatrix();
+    const Frustum frustum = _camera->getFrustum();
+    uploadFrameUniforms();
+
+    // obstacles near enough and inside the frustum
+    const float cameraZ = _camera->transform.position.z;
+    const float reach = _obstacles.getMaxReach().z;
+    const auto window = _obstacles.window(cameraZ - _camera->zfar - reach, cameraZ + reach);
+    _obstacleBoxes.clear();
+    for (const auto& obstacle : window) {
+        _obstacleBoxes.push_back(obstacle.getWorldBoundingBox());
+    }
+    _visibleObstacles.clear();
+    frustum.cull(_obstacleBoxes.data(), _obstacleBoxes.size(), _visibleObstacles);
+
+    // cpu occlusion: the nearest obstacles in view are rasterised into a small depth
+    // buffer, obstacles behind them are dropped before anything reaches gl
+    _cpuOccludedCount = 0;
+    if (_cpuOcclusionCulling) {
+        _occlusionRasterizer->beginFrame(*_camera);
+        size_t occluders = 0;
+        for (auto index : _visibleObstacles) {
+            const Obstacle& obstacle = window.begin()[index];
+            const Model& mesh = obstacle.getMesh();
+            if (mesh.getFaceCount() > maxOccluderFaces) {
+                continue;
+            }
+            _occlusionRasterizer->addOccluder(
+                mesh.getVertices(), mesh.getIndices(), obstacle.transform.getLocalMatrix());
+            if (++occluders == maxOccluders) {
+                break;
+            }
+        }
+        _occlusionRasterizer->rasterize();
+
+        const size_t count = _visibleObstacles.size();
+        _visibleObstacles.erase(
+            std::remove_if(
+                _visibleObstacles.begin(), _visibleObstacles.end(),
+                [this](uint32_t index) {
+                    return !_occlusionRasterizer->isVisible(_obstacleBoxes[index]);
+                }),
+            _visibleObstacles.end());
+        _cpuOccludedCount = count - _visibleObstacles.size();
+    }
 
-    // 1. use the shader
-    _textureShader->use();
-    
-    // 2. transfer mvp matrices to gpu
-    _groundTexture->bind(0);
-    // _textureShader->setUniformInt("mapKd", 0);
-
-    _textureShader->setUniformMat4("projection", projection);
-    _textureShader->setUniformMat4("view", view);
-    _textureShader->setUniformMat4("model", _character->transform.getLocalMatrix());
-    _textureShader->setUniformVec3("ambientLight.color", _ambientLight->color);
-    _textureShader->setUniformFloat("ambientLight.intensity", _ambientLight->intensity);
-
-    for (auto &it : _groundTransforms){
-        //_ground->transform = it;
-        _textureShader->setUniformMat4("model", it.getLocalMatrix());
-        _ground->draw();
-    }
-    // // 3. enable textures and transform textures to gpu
-    // _simpleMaterial->mapKd->bind();
-    // _textureShader->unuse();
-    // _sphere->draw();
-    
-    // for the usual shader
-    _usualShader->use();
-    // 1. transfer mvp matrix to the shader
-    _usualShader->setUniformMat4("projection", projection);
-    _usualShader->setUniformMat4("view", view);
-    _usualShader->setUniformMat4("model", _ground->transform.getLocalMatrix());
-
-    _usualShader->setUniformVec3("viewPos", _camera->transform.position);
-
-    _usualShader->setUniformVec3("material.ka", _phongMaterial->ka);
-    _usualShader->setUniformVec3("material.kd", _phongMaterial->kd);
-    _usualShader->setUniformVec3("material.ks", _phongMaterial->ks);
-    _usualShader->setUniformFloat("material.ns", _phongMaterial->ns);
-    
-    _usualShader->setUniformVec3("ambientLight.color", _ambientLight->color);
-    _usualShader->setUniformFloat("ambientLight.intensity", _ambientLight->intensity);
-    _usualShader->setUniformVec3("spotLight.position", _spotLight->transform.position);
-    _usualShader->setUniformVec3("spotLight.direction", _spotLight->transform.getFront()); //point down
-    _usualShader->setUniformFloat("spotLight.intensity", _spotLight->intensity);
-    _usualShader->setUniformVec3("spotLight.color", _spotLight->color);
-    _usualShader->setUniformFloat("spotLight.angle", _spotLight->angle);
-    _usualShader->setUniformFloat("spotLight.kc", _spotLight->kc);
-    _usualShader->setUniformFloat("spotLight.kl", _spotLight->kl);
-    _usualShader->setUniformFloat("spotLight.kq", _spotLight->kq);
-    _usualShader->setUniformVec3(
-        "directionalLight.direction", _directionalLight->transform.getFront());
-    _usualShader->setUniformFloat("directionalLight.intensity", _directionalLight->intensity);
-    _usualShader->setUniformVec3("directionalLight.color", _directionalLight->color);
-
-    _usualShader->setUniformMat4("model", _character->transform.getLocalMatrix());
-    _character->draw();
-    //std::cout << _obstacles.size() << std::endl;
-    for(auto &obstacle:_obstacles){
-        _usualShader->setUniformMat4("model", obstacle.transform.getLocalMatrix());
-        obstacle.draw();
-        //std::cout << obstacle.getVao() << std::endl;
-    }
-    // draw skybox
-    _skybox->draw(projection, view); //draw at last
+    _renderQueue.beginFrame();
+    _renderQueue.setDepthRange(_camera->zfar);
+    const glm::vec3 eye = _camera->transform.position;
+    auto viewDistance = [&eye](const BoundingBox& box) {
+        return glm::length(glm::clamp(eye, box.min, box.max) - eye);
+    };
+
+    // terrain chunks in view at their level of detail. the ground takes no spot light and
+    // no specular
+    const ShaderVariants::Features groundFeatures =
+        SceneFeature::Texture | SceneFeature::WorldUv |
+        (getLitFeatures() &
+         (SceneFeature::DirectionalLight | SceneFeature::ClusteredLights | SceneFeature::Shadows));
+    const uint8_t groundShaderId = getSceneShaderId(groundFeatures);
+    _terrainDraws.clear();
+    _terrain->getDraws(_terrainDraws);
+    for (const auto& chunk : _terrainDraws) {
+        if (frustum.intersect(chunk.box)) {
+            _renderQueue.submit(
+                RenderQueue::Pass::Opaque, groundShaderId, _groundMaterialId, chunk.draw,
+                viewDistance(chunk.box), &chunk.model);
+        }
+    }
+
+    // character, lit meshes share the material and so the shader features
+    const ShaderVariants::Features litFeatures = getLitFeatures();
+    const BoundingBox& characterBox = _character->getWorldBoundingBox();
+    const Model::Lod characterLod = _character->getLod(_characterLod);
+    _characterModel = _character->transform.getLocalMatrix();
+    if (frustum.intersect(characterBox)) {
+        RenderQueue::DrawCall characterDraw;
+        characterDraw.vao = _character->getVao();
+        characterDraw.indexCount = characterLod.indexCount;
+        characterDraw.firstIndex = characterLod.firstIndex;
+        _renderQueue.submit(
+            RenderQueue::Pass::Opaque, getSceneShaderId(litFeatures), RenderQueue::noMaterial,
+            characterDraw, viewDistance(characterBox), &_characterModel);
+    }
+
+    // obstacles sharing a mesh are drawn with one instanced call per mesh, each level of
+    // detail being a mesh of its own. the level follows the projected size of the box
+    for (auto& batch : _obstacleBatches) {
+        batch.instances.clear();
+        batch.nearest = _camera->zfar;
+    }
+    const bool occlusionCulling = _occlusionCulling && !wireframe;
+    if (occlusionCulling) {
+        _occlusionCuller->beginFrame();
+    }
+    const float tanHalfFovy = std::tan(0.5f * _camera->fovy);
+    std::fill(std::begin(_obstacleLodCounts), std::end(_obstacleLodCounts), 0);
+    _obstacleVertexCount = 0;
+    for (auto index : _visibleObstacles) {
+        Obstacle& obstacle = window.begin()[index];
+        if (occlusionCulling && !_occlusionCuller->isVisible(obstacle._id)) {
+            continue;
+        }
+        const BoundingBox& box = _obstacleBoxes[index];
+        size_t level = 0;
+        if (_obstacleLod) {
+            const float radius = 0.5f * glm::length(box.max - box.min);
+            const float distance = glm::length(0.5f * (box.min + box.max) - eye);
+            level = obstacle.selectLod(radius / (std::max(distance, radius) * tanHalfFovy));
+        }
+        ObstacleBatch& batch = getObstacleBatch(obstacle.getSharedLodMesh(level));
+        batch.instances.push_back(obstacle.transform.getLocalMatrix());
+        batch.nearest = std::min(batch.nearest, viewDistance(box));
+        ++_obstacleLodCounts[level];
+        _obstacleVertexCount += obstacle.getLodMesh(level).getVertices().size();
+    }
+    const uint8_t obstacleShaderId = getSceneShaderId(litFeatures | SceneFeature::Instanced);
+    for (auto& batch : _obstacleBatches) {
+        batch.model->updateInstances(batch.instances);
+        if (batch.instances.empty()) {
+            continue;
+        }
+
+        RenderQueue::DrawCall batchDraw;
+        batchDraw.vao = batch.model->getVao();
+        batchDraw.indexCount = static_cast<GLsizei>(batch.model->getMesh().getIndices().size());
+        batchDraw.instanceCount = static_cast<GLsizei>(batch.instances.size());
+        _renderQueue.submit(
+            RenderQueue::Pass::Opaque, obstacleShaderId, RenderQueue::noMaterial, batchDraw,
+            batch.nearest);
+    }
+    // optional depth pre-pass: the opaque draws lay down depth with a position only
+    // program, then the phong pass only shades the fragments that stay visible
+    auto& cache = GLStateCache::instance();
+    if (_depthPrePass) {
+        _depthPrePassTimer->begin();
+        cache.colorMask(false, false, false, false);
+        cache.depthMask(true);
+        cache.depthFunc(GL_LESS);
+        _renderQueue.flushDepth();
+        cache.colorMask(true, true, true, true);
+        cache.depthMask(false);
+        cache.depthFunc(GL_LEQUAL);
+        _depthPrePassTimer->end();
+    }
+    _opaqueTimer->begin();
+    _renderQueue.flush();
+    _opaqueTimer->end();
+    if (_depthPrePass) {
+        cache.depthMask(true);
+        cache.depthFunc(GL_LESS);
+    }
+
+    // the depth buffer now holds every occluder, test the boxes of all obstacles in view
+    // against it, hidden ones included so they come back once revealed
+    if (occlusionCulling) {
+        _occlusionCuller->beginQueries(projection, view);
+        for (auto index : _visibleObstacles) {
+            const Obstacle& obstacle = window.begin()[index];
+            _occlusionCuller->query(
+                obstacle._id, obstacle.getMesh(), obstacle.transform.getLocalMatrix(),
+                _obstacleBoxes[index]);
+        }
+        _occlusionCuller->endQueries();
+    }
+
+    // draw skybox at last
+    _renderQueue.submit(RenderQueue::Pass::Background, _camera->zfar, [&]() {
+        _skybox->draw();
+    });
+    _renderQueue.flush();
 
     // draw ui elements
     ImGui_ImplOpenGL3_NewFrame();
@@ -488,6 +821,60 @@ void Game::renderFrame() {
         ImGui::Text("Render Mode");
         ImGui::Separator();
 
+        ImGui::Checkbox("occlusion culling", &_occlusionCulling);
+        ImGui::Text("occluded obstacles: %zu", _occlusionCuller->getHiddenCount());
+        ImGui::Checkbox("cpu occlusion culling", &_cpuOcclusionCulling);
+        ImGui::Text("cpu occluded obstacles: %zu", _cpuOccludedCount);
+        const RenderQueue::Statistics& statistics = _renderQueue.getStatistics();
+        ImGui::Text(
+            "draws: %zu, shader/material/vao changes: %zu/%zu/%zu", statistics.drawCount,
+            statistics.shaderChanges, statistics.materialChanges, statistics.vaoChanges);
+        ImGui::Checkbox("obstacle lod", &_obstacleLod);
+        ImGui::Text(
+            "obstacles per lod: %zu/%zu/%zu, vertices: %zu", _obstacleLodCounts[0],
+            _obstacleLodCounts[1], _obstacleLodCounts[2], _obstacleVertexCount);
+        ImGui::SliderFloat("lod error (pixels)", &_lodPixelError, 0.25f, 16.0f);
+        ImGui::Text(
+            "character: %d of %zu triangles", characterLod.indexCount / 3,
+            _character->getIndices().size() / 3);
+        if (ImGui::TreeNode("vertex cache acmr/atvr")) {
+            auto showReport = [](const std::string& name, const Model& mesh) {
+                const MeshOptimizer::Report& report = mesh.getMeshReport();
+                ImGui::Text(
+                    "%s: %.2f/%.2f -> %.2f/%.2f", name.c_str(), report.before.acmr,
+                    report.before.atvr, report.after.acmr, report.after.atvr);
+            };
+            showReport("character", *_character);
+            _meshLibrary->forEach(showReport);
+            ImGui::TreePop();
+        }
+        ImGui::Checkbox("normal matrix inverse in shader", &_inverseInShader);
+        ImGui::Text("scene shader variants: %zu", _sceneShaders->getVariantCount());
+        ImGui::Checkbox("shadows", &_shadows);
+        for (int i = 0; i < _shadowMap->getCascadeCount(); ++i) {
+            const CascadedShadowMap::Statistics& cascade = _shadowMap->getStatistics(i);
+            ImGui::Text(
+                "cascade %d: static renders %zu, layer updates %zu of %zu frames", i,
+                cascade.staticRenders, cascade.layerUpdates, cascade.frames);
+        }
+        ImGui::SliderInt("track lights", &_trackLightCount, 0, 512);
+        ImGui::Text(
+            "light binning: %.3f ms, %zu lights in clusters",
+            _lightClusters->getBinningMilliseconds(), _lightClusters->getAssignedCount());
+        const ChunkedTerrain::Statistics& terrain = _terrain->getStatistics();
+        ImGui::Text(
+            "terrain chunks: %zu resident, %zu generating, %zu triangles",
+            terrain.residentChunks, terrain.pendingChunks, terrain.triangles);
+        ImGui::Checkbox("depth pre-pass", &_depthPrePass);
+        const double prePassTime = _depthPrePass ? _depthPrePassTimer->getMilliseconds() : 0.0;
+        ImGui::Text(
+            "gpu time: depth pre-pass %.3f ms + opaque pass %.3f ms = %.3f ms", prePassTime,
+            _opaqueTimer->getMilliseconds(), prePassTime + _opaqueTimer->getMilliseconds());
+        const GLStateCache::Statistics& stateStatistics = GLStateCache::instance().getStatistics();
+        ImGui::Text(
+            "gl state calls issued/skipped: %zu/%zu", stateStatistics.issued,
+            stateStatistics.skipped);
+
         ImGui::ColorEdit3("ka##3", (float*)&_phongMaterial->ka);
         ImGui::ColorEdit3("kd##3", (float*)&_phongMaterial->kd);
         ImGui::ColorEdit3("ks##3", (float*)&_phongMaterial->ks);
@@ -521,6 +908,180 @@ void Game::renderFrame() {
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
 
+ObstacleBatch& Game::getObstacleBatch(const std::shared_ptr<const Model>& mesh) {
+    // only a handful of meshes exist, a linear search beats hashing here
+    for (auto& batch : _obstacleBatches) {
+        if (&batch.model->getMesh() == mesh.get()) {
+            return batch;
+        }
+    }
+
+    ObstacleBatch batch;
+    batch.model.reset(new InstancedModel(mesh));
+    _obstacleBatches.push_back(std::move(batch));
+
+    return _obstacleBatches.back();
+}
+
+void Game::uploadPhongUniforms(const GLSLProgram& shader, const PhongUniforms& uniforms) {
+    shader.setUniform(uniforms.ka, _phongMaterial->ka);
+    shader.setUniform(uniforms.kd, _phongMaterial->kd);
+    shader.setUniform(uniforms.ks, _phongMaterial->ks);
+    shader.setUniform(uniforms.ns, _phongMaterial->ns);
+}
+
+ShaderVariants::Features Game::getLitFeatures() const {
+    // lights and terms contributing nothing are compiled out instead of branched over
+    ShaderVariants::Features features = 0;
+    if (_directionalLight->intensity > 0.0f) {
+        features |= SceneFeature::DirectionalLight;
+    }
+    if (_spotLight->intensity > 0.0f) {
+        features |= SceneFeature::SpotLight;
+    }
+    if (_phongMaterial->ks != glm::vec3(0.0f)) {
+        features |= SceneFeature::Specular;
+    }
+    if (_inverseInShader) {
+        features |= SceneFeature::InverseInShader;
+    }
+    if (_lightClusters->getLightCount() > 0) {
+        features |= SceneFeature::ClusteredLights;
+    }
+    if (_shadows && (features & SceneFeature::DirectionalLight)) {
+        features |= SceneFeature::Shadows;
+    }
+
+    return features;
+}
+
+uint8_t Game::getSceneShaderId(ShaderVariants::Features features) {
+    auto it = _sceneShaderSlots.find(features);
+    if (it != _sceneShaderSlots.end()) {
+        return it->second.id;
+    }
+
+    // the material is uploaded once when the variant is first used in the frame, the
+    // slot stays at its address in the map for the setup to refer to
+    GLSLProgram& shader = _sceneShaders->get(features);
+    SceneShader& slot = _sceneShaderSlots[features];
+    slot.uniforms.resolve(shader);
+    const PhongUniforms* uniforms = &slot.uniforms;
+    slot.id = _renderQueue.registerShader(&shader, [this, uniforms](GLSLProgram& program) {
+        uploadPhongUniforms(program, *uniforms);
+    });
+
+    return slot.id;
+}
+
+void Game::updateTrackLights() {
+    static const glm::vec3 palette[] = {
+        {1.0f, 0.6f, 0.2f}, {0.3f, 0.6f, 1.0f}, {1.0f, 0.3f, 0.5f}, {0.4f, 1.0f, 0.5f}};
+
+    // rows are fixed in world space so lamps do not slide along with the camera, more
+    // lamps pack the rows closer
+    _lightClusters->clear();
+    const int rows = (_trackLightCount + trackLightsPerRow - 1) / trackLightsPerRow;
+    if (rows > 0) {
+        const float spacing = trackLightDistance / rows;
+        const float cameraZ = _camera->transform.position.z;
+        const int firstRow = static_cast<int>(std::floor(cameraZ / spacing));
+        PointLight lamp;
+        lamp.intensity = 1.5f;
+        for (int i = 0; i < _trackLightCount; ++i) {
+            const int row = firstRow - i / trackLightsPerRow;
+            const int column = i % trackLightsPerRow;
+            lamp.transform.position = glm::vec3(
+                -7.5f + 5.0f * column, 1.5f, static_cast<float>(row) * spacing);
+            lamp.color = palette[(row + column) & 3];
+            _lightClusters->addPointLight(lamp);
+        }
+    }
+
+    _lightClusters->update(*_camera, clusterMaxDepth);
+    _lightClusters->bind(clusterLightUnit, clusterListUnit);
+}
+
+void Game::renderShadows() {
+    _shadowDynamicBoxes.clear();
+    _shadowDynamicBoxes.push_back(_character->getWorldBoundingBox());
+
+    _shadowShader->use();
+    _shadowMap->update(
+        *_camera, _directionalLight->transform.getFront(), _shadowDynamicBoxes,
+        [this](int cascade, const glm::mat4& lightViewProjection) {
+            drawStaticShadowCasters(cascade, lightViewProjection);
+        },
+        [this](int, const glm::mat4& lightViewProjection) {
+            _shadowShader->setUniform(_shadowViewProjection, lightViewProjection);
+            _shadowShader->setUniform(_shadowModel, _character->transform.getLocalMatrix());
+            _character->drawLod(_characterLod);
+        });
+}
+
+void Game::selectCharacterLod() {
+    // keeps the simplification error below _lodPixelError pixels
+    const glm::vec3& eye = _camera->transform.position;
+    const BoundingBox& box = _character->getWorldBoundingBox();
+    const float pixelPerDistance = 2.0f * std::tan(0.5f * _camera->fovy) / _windowHeight;
+    _characterLod = _character->selectLod(
+        glm::length(glm::clamp(eye, box.min, box.max) - eye), _lodPixelError * pixelPerDistance);
+}
+
+void Game::drawStaticShadowCasters(int cascade, const glm::mat4& lightViewProjection) {
+    _shadowShader->setUniform(_shadowViewProjection, lightViewProjection);
+    // every chunk at the same level, so no edge needs stitching
+    _terrainDraws.clear();
+    _terrain->getDraws(_terrainDraws, terrainShadowLevel);
+    for (const auto& chunk : _terrainDraws) {
+        if (_shadowMap->overlaps(cascade, chunk.box)) {
+            _shadowShader->setUniform(_shadowModel, chunk.model);
+            GLStateCache::instance().bindVertexArray(chunk.draw.vao);
+            glDrawElements(
+                GL_TRIANGLES, chunk.draw.indexCount, GL_UNSIGNED_INT,
+                reinterpret_cast<const void*>(chunk.draw.firstIndex * sizeof(uint32_t)));
+        }
+    }
+
+    // rare enough that one draw per obstacle does, the visible batches hold other sets.
+    // a fixed level keeps the cached depth the same wherever the camera is
+    const float far = std::numeric_limits<float>::max();
+    for (const auto& obstacle : _obstacles.window(-far, far)) {
+        if (_shadowMap->overlaps(cascade, obstacle.getWorldBoundingBox())) {
+            _shadowShader->setUniform(_shadowModel, obstacle.transform.getLocalMatrix());
+            obstacle.getLodMesh(std::min(obstacleShadowLod, obstacle.getLodCount() - 1)).draw();
+        }
+    }
+}
+
+void Game::uploadFrameUniforms() {
+    _frameData.setCamera(*_camera);
+    _frameData.setAmbientLight(*_ambientLight);
+    _frameData.setDirectionalLight(*_directionalLight);
+    _frameData.setSpotLight(*_spotLight);
+    _frameData.setLightClusters(*_lightClusters, _windowWidth, _windowHeight);
+    if (_shadows) {
+        _frameData.setShadows(*_shadowMap);
+        _shadowMap->bind(shadowMapUnit);
+    }
+
+    _frameUniformBuffer->upload(_frameData);
+}
+
+void PhongUniforms::resolve(const GLSLProgram& shader) {
+    ka = shader.getUniformHandle<glm::vec3>("material.ka");
+    kd = shader.getUniformHandle<glm::vec3>("material.kd");
+    ks = shader.getUniformHandle<glm::vec3>("material.ks");
+    ns = shader.getUniformHandle<float>("material.ns");
+}
+
+void Game::streamTerrain() {
+    _terrain->update(_camera->transform.position, terrainAhead, terrainBehind);
+    for (const BoundingBox& box : _terrain->getChangedBoxes()) {
+        _shadowMap->invalidate(box);
+    }
+}
+
 void Game::initObstacles() {
     int num = 5; // easy mode
     //generateRandomObstacles(num,1.0,5.0, -10.0, 10.0, -10.0, 0);
@@ -529,6 +1090,14 @@ void Game::initObstacles() {
 void Game::generateRandomObstacles(
     int obstacleCount, float minLength, float maxLength, float minX, float maxX, float minZ,
     float maxZ) {
+    // the track is kept in z order, spawn nothing nearer than its current far end
+    if (!_obstacles.empty()) {
+        maxZ = std::min(maxZ, _obstacles.back().transform.position.z);
+    }
+    if (maxZ <= minZ) {
+        return;
+    }
+
     std::random_device rd;
     std::mt19937 gen(rd());
     std::uniform_real_distribution<float> distX(minX, maxX);
@@ -537,10 +1106,12 @@ void Game::generateRandomObstacles(
     std::uniform_real_distribution<float> distLength(minLength, maxLength); // 设置障碍物的长度范围
     std::uniform_real_distribution<float> distHeight(0.5f, 1.5f);
     std::uniform_real_distribution<> shape(0, 6);
-    std::set<std::pair<float, float>> obstaclePositions;
+    std::vector<Obstacle> spawned;
 
+    // the narrowed range may not fit them all, give up on the rest after a while
+    const int maxAttempts = 20 * obstacleCount;
     int generatedCount = 0;
-    while (generatedCount < obstacleCount) {
+    for (int attempt = 0; generatedCount < obstacleCount && attempt < maxAttempts; ++attempt) {
         float x = distX(gen);
         float z = distZ(gen);
         float length = 1.0f; // 随机生成障碍物的长度
@@ -559,36 +1130,65 @@ void Game::generateRandomObstacles(
         // x += offsetX;
         // z += offsetZ;
 
-        bool flag = detectHurdle(x, z);
+        bool flag = detectHurdle(x, z, spawned);
         if (!flag) {
             //std::cout << "failed" << std::endl;
             continue;
         }
         int shape_ = shape(gen);
-        Obstacle cur(shape_);
+        Obstacle cur(*_meshLibrary, shape_);
         cur.transform.position.x = x;
         cur.transform.position.z = z;
-        float height = cur.getBoundingBox().min.y; // get the height of the character
-        cur.transform.position.y = -height;        // move to exactly the ground
-        // cur.transform.scale.x = length;
-        // cur.transform.scale.y = Height;
+        if (cur._shape != 1) { // keep spheres round for the radius based collision
+            cur.transform.scale.x = length;
+            cur.transform.scale.y = Height;
+        }
+        float height = cur.getBoundingBox().min.y * cur.transform.scale.y;
+        cur.transform.position.y = -height; // move to exactly the ground
 
-        _obstacles.insert(std::move(cur));
+        spawned.push_back(std::move(cur));
         ++generatedCount;
     }
 
+    // append at the far end of the track in z order
+    std::sort(spawned.begin(), spawned.end(), [](const Obstacle& lhs, const Obstacle& rhs) {
+        return lhs.transform.position.z > rhs.transform.position.z;
+    });
+    for (auto& obstacle : spawned) {
+        const Obstacle& added = _obstacles.push(std::move(obstacle));
+        _obstacleGrid.insert(added._id, added.getWorldBoundingBox());
+        _shadowMap->invalidate(added.getWorldBoundingBox());
+        if (added._shape == 1) { //sphere
+            _obstacleColliders.pushSphere(added.transform.position, added._shapeInfo);
+        } else {
+            _obstacleColliders.pushBox(added.getWorldBoundingBox());
+        }
+    }
 }
 
-bool Game::detectHurdle(float x, float z){
-    for(auto& hurdle: _obstacles){
+bool Game::detectHurdle(float x, float z, const std::vector<Obstacle>& pending){
+    auto blocks = [x, z](const Obstacle& hurdle) {
         float hurdlex = hurdle.transform.position.x;
-        float distx = hurdle.getBoundingBox().max.x; //perhaps 0.5
+        float distx = hurdle.getBoundingBox().max.x * hurdle.transform.scale.x; //perhaps 0.5
         float hurdlez = hurdle.transform.position.z;
-        float distz = hurdle.getBoundingBox().max.z; //perhaps 0.5
-        if(abs(x-hurdlex)>2*distx || abs(z-hurdlez)>2*distz){
-            
-        }else{
-            // std::cout << x << "  " << z << "  " << hurdlex << "  " << hurdlez << std::endl;
+        float distz = hurdle.getBoundingBox().max.z * hurdle.transform.scale.z; //perhaps 0.5
+        return !(abs(x - hurdlex) > 2 * distx || abs(z - hurdlez) > 2 * distz);
+    };
+
+    // a hurdle blocks at most twice its half extent away from its center, so its
+    // world box reaches into the cells around (x, z) within the largest half extent
+    const glm::vec3 reach = _obstacles.getMaxReach();
+    BoundingBox area;
+    area.min = glm::vec3(x - reach.x, 0.0f, z - reach.z);
+    area.max = glm::vec3(x + reach.x, 0.0f, z + reach.z);
+    _obstacleGrid.query(area, _gridCandidates);
+    for(auto id: _gridCandidates){
+        if(blocks(*_obstacles.find(id))){
+            return false;
+        }
+    }
+    for(auto& hurdle: pending){
+        if(blocks(hurdle)){
             return false;
         }
     }
@@ -596,56 +1196,23 @@ bool Game::detectHurdle(float x, float z){
 }
 
 bool Game::collisionDetect(){
-    BoundingBox box1 = transformBoundingBox(_character->getBoundingBox(),_character->transform.getLocalMatrix());
-    glm::vec3 aabb_center = _character->transform.position;
-    for(auto it=_obstacles.begin();it!=_obstacles.end();++it){
-        if(it->_shape==1){  //sphere
-            glm::vec3 sphere_center = it->transform.position;
-            //glm::vec3 diff = sphere_center - aabb_center;
-            glm::vec3 clamped = glm::clamp(sphere_center,box1.min,box1.max);
-            glm::vec3 difference = clamped - sphere_center;
-            if(glm::length(difference) < it->_shapeInfo){  //in the sphere
-                return true;
-            }
-            continue;
-        }
-
-        BoundingBox box2 = transformBoundingBox(it->getBoundingBox(),it->transform.getLocalMatrix());
-        // 检查每个维度上的重叠
-        bool xOverlap = (box1.min.x <= box2.max.x) && (box1.max.x >= box2.min.x);
-        bool yOverlap = (box1.min.y <= box2.max.y) && (box1.max.y >= box2.min.y);
-        bool zOverlap = (box1.min.z <= box2.max.z) && (box1.max.z >= box2.min.z);
-        bool flag = xOverlap && yOverlap && zOverlap;
-        if(flag){ // 如果三个维度上都有重叠，则认为发生碰撞
-            return true;
-        }
+    const BoundingBox& box1 = _character->getWorldBoundingBox();
+    // broadphase: only obstacles sharing a grid cell with the character can overlap it
+    _obstacleGrid.query(box1, _gridCandidates);
+    if (_gridCandidates.empty()) {
+        return false;
     }
 
-    return false;
+    // narrowphase: track ids index the colliders, the sorted candidates span a short
+    // contiguous run which is tested several obstacles at a time
+    const uint64_t front = _obstacles.front()._id;
+    return _obstacleColliders.intersects(
+        box1, static_cast<size_t>(_gridCandidates.front() - front),
+        static_cast<size_t>(_gridCandidates.back() - front + 1));
 }
 
 BoundingBox Game::transformBoundingBox(const BoundingBox& box, const glm::mat4& transform) {
-    BoundingBox transformedBox;
-
-    // Transform each corner of the bounding box
-    glm::vec3 corners[8] = {
-        glm::vec3(box.min.x, box.min.y, box.min.z),
-        glm::vec3(box.min.x, box.min.y, box.max.z),
-        glm::vec3(box.min.x, box.max.y, box.min.z),
-        glm::vec3(box.min.x, box.max.y, box.max.z),
-        glm::vec3(box.max.x, box.min.y, box.min.z),
-        glm::vec3(box.max.x, box.min.y, box.max.z),
-        glm::vec3(box.max.x, box.max.y, box.min.z),
-        glm::vec3(box.max.x, box.max.y, box.max.z)
-    };
-
-    for (int i = 0; i < 8; ++i) {
-        glm::vec4 transformedPoint = transform * glm::vec4(corners[i], 1.0f);
-        transformedBox.min = glm::min(transformedBox.min, glm::vec3(transformedPoint));
-        transformedBox.max = glm::max(transformedBox.max, glm::vec3(transformedPoint));
-    }
-
-    return transformedBox;
+    return box.transform(transform);
 }
 
 void Game::testOn(){
@@ -3,17 +3,35 @@
 #include <memory>
 #include <string>
 #include <set>
+#include <unordered_map>
 #include <unordered_set>
 #include <deque>
 
 #include "../base/application.h"
 #include "../base/camera.h"
+#include "../base/cascaded_shadow_map.h"
+#include "../base/chunked_terrain.h"
+#include "../base/collider_batch.h"
+#include "../base/frame_uniform_block.h"
+#include "../base/gl_state_cache.h"
+#include "../base/gpu_timer.h"
 #include "../base/glsl_program.h"
+#include "../base/instanced_model.h"
 #include "../base/light.h"
+#include "../base/light_clusters.h"
+#include "../base/mesh_library.h"
 #include "../base/model.h"
+#include "../base/occlusion_culler.h"
+#include "../base/occlusion_rasterizer.h"
+#include "../base/render_queue.h"
+#include "../base/shader_variants.h"
 #include "../base/skybox.h"
+#include "../base/spatial_hash.h"
 #include "../base/texture2d.h"
+#include "../base/thread_pool.h"
+#include "../base/uniform_buffer.h"
 #include "obstacle.h"
+#include "obstacle_track.h"
 
 struct SimpleMaterial {
     std::shared_ptr<Texture2D> mapKd;
@@ -26,6 +44,47 @@ struct PhongMaterial {
     float ns;
 };
 
+// all visible obstacles sharing one mesh, drawn with a single instanced call
+struct ObstacleBatch {
+    std::unique_ptr<InstancedModel> model;
+    std::vector<glm::mat4> instances; // rebuilt every frame
+    float nearest = 0.0f; // view distance of the nearest instance, sorts the batch
+};
+
+// features of the scene shader, one bit each, in the order of the macro names passed to
+// its ShaderVariants
+namespace SceneFeature {
+enum : ShaderVariants::Features {
+    Texture = 1u << 0, // ka and kd sampled from mapKd
+    DirectionalLight = 1u << 1,
+    SpotLight = 1u << 2,
+    Specular = 1u << 3,
+    Instanced = 1u << 4, // per-instance model and normal matrices
+    InverseInShader = 1u << 5, // normals through the per vertex inverse of the model matrix
+    ClusteredLights = 1u << 6, // the point and spot lights of the fragment's cluster
+    Shadows = 1u << 7, // the directional light through the cascaded shadow map
+    WorldUv = 1u << 8 // texture coordinates from the world x and z, one texture per tile
+};
+}
+
+// material of a scene shader variant, resolved once after linking. uniforms compiled out
+// of the variant stay invalid and are skipped. camera and lights are shared by all
+// programs through the FrameData uniform block
+struct PhongUniforms {
+    UniformHandle<glm::vec3> ka;
+    UniformHandle<glm::vec3> kd;
+    UniformHandle<glm::vec3> ks;
+    UniformHandle<float> ns;
+
+    void resolve(const GLSLProgram& shader);
+};
+
+// a scene shader variant registered with the render queue
+struct SceneShader {
+    uint8_t id = 0;
+    PhongUniforms uniforms;
+};
+
 class Game : public Application {
 public:
     Game(const Options& options);
@@ -35,9 +94,7 @@ public:
 private:
     std::unique_ptr<Model> _character;
 
-    std::unique_ptr<Model> _ground;
-    std::unique_ptr<ImageTexture2D> _groundTexture;
-    std::deque<Transform> _groundTransforms;
+    std::unique_ptr<ImageTexture2D> _groundTexture; //on the terrain, in world space
 
     std::unique_ptr<SimpleMaterial> _simpleMaterial;
     std::unique_ptr<PhongMaterial> _phongMaterial;
@@ -48,12 +105,66 @@ private:
     std::unique_ptr<DirectionalLight> _directionalLight;
     std::unique_ptr<SpotLight> _spotLight;
 
-    std::unique_ptr<GLSLProgram> _textureShader; //for texture
-    std::unique_ptr<GLSLProgram> _usualShader; //the ususal ones
+    // lamps along the track, lit through the clusters of the view frustum
+    std::unique_ptr<LightClusters> _lightClusters;
+    int _trackLightCount = 64;
+
+    // shadows of the directional light, the character is the only dynamic caster
+    std::unique_ptr<CascadedShadowMap> _shadowMap;
+    std::unique_ptr<GLSLProgram> _shadowShader; //depth only
+    UniformHandle<glm::mat4> _shadowModel;
+    UniformHandle<glm::mat4> _shadowViewProjection;
+    std::vector<BoundingBox> _shadowDynamicBoxes;
+    bool _shadows = true;
+
+    // every mesh of the scene is drawn with a variant of one phong shader
+    std::unique_ptr<ShaderVariants> _sceneShaders;
+    std::unique_ptr<ShaderVariants> _depthShaders; //same vertex stage, no fragment work
+    std::unordered_map<ShaderVariants::Features, SceneShader> _sceneShaderSlots;
+
+    // camera and lights of the frame, uploaded once and bound for every program
+    FrameUniformBlock _frameData;
+    std::unique_ptr<UniformBuffer> _frameUniformBuffer;
 
     std::unique_ptr<SkyBox> _skybox;
 
-    std::set<Obstacle> _obstacles; 
+    // draws of a frame sorted to avoid redundant shader, material and vao changes
+    RenderQueue _renderQueue;
+    uint8_t _groundMaterialId = 0;
+
+    // obstacle geometry shared by every obstacle of the same shape
+    std::unique_ptr<MeshLibrary> _meshLibrary;
+
+    ObstacleTrack _obstacles; //sorted by z, nearest first
+    SpatialHash _obstacleGrid{2.0f}; //x-z broadphase over the world boxes of _obstacles
+    std::vector<uint64_t> _gridCandidates; //query results, kept to reuse the storage
+    ColliderBatch _obstacleColliders; //world space colliders in the same order as _obstacles
+    std::vector<BoundingBox> _obstacleBoxes; //world boxes of the obstacles near the camera
+    std::vector<uint32_t> _visibleObstacles; //indices into _obstacleBoxes that get drawn
+    std::vector<ObstacleBatch> _obstacleBatches;
+    bool _obstacleLod = true; //coarser meshes for obstacles small on screen
+    float _lodPixelError = 1.0f; //simplification error allowed on screen for loaded models
+    size_t _characterLod = 0; //picked once per frame for the shadow and the opaque pass
+    glm::mat4 _characterModel; //the render queue points to it until the flush
+    size_t _obstacleLodCounts[3] = {}; //drawn obstacles per level in the last frame
+    size_t _obstacleVertexCount = 0;
+
+    std::unique_ptr<ThreadPool> _threadPool; //workers shared by the cpu side passes
+
+    // hills streamed along the track, generated on the pool so declared after it
+    std::unique_ptr<ChunkedTerrain> _terrain;
+    std::vector<ChunkedTerrain::ChunkDraw> _terrainDraws;
+
+    std::unique_ptr<OcclusionCuller> _occlusionCuller; //skips obstacles hidden behind others
+    bool _occlusionCulling = true;
+    std::unique_ptr<OcclusionRasterizer> _occlusionRasterizer; //the same on the cpu, no readback
+    bool _cpuOcclusionCulling = true;
+    size_t _cpuOccludedCount = 0;
+
+    std::unique_ptr<GpuTimer> _opaqueTimer; //gpu time of the opaque pass
+    std::unique_ptr<GpuTimer> _depthPrePassTimer;
+    bool _depthPrePass = false; //pays off once obstacles hide much of what is behind them
+    bool _inverseInShader = false; //normal matrices the old way, to compare the timings
 
     float _speed = 4.0f; //character move speed
     float _velocity = 0;
@@ -69,15 +180,19 @@ private:
 
     float _moveForward = 0; //move forward distance
     
-    void initTextureShader();
-    void initPhongShader();
+    // begins linking the scene shader variants the first frames need
+    void initSceneShaders();
+
+    // waits for the links begun by initSceneShaders()
+    void finishShaders();
+    void initRenderQueue();
 
     void initObstacles();
     //void generateRandomObstacles(int obstacleCount, float minX, float maxX, float minZ, float maxZ);
     void generateRandomObstacles(
         int obstacleCount, float minLength, float maxLength, float minX,
         float maxX, float minZ, float maxZ);
-    bool detectHurdle(float x, float z);
+    bool detectHurdle(float x, float z, const std::vector<Obstacle>& pending);
     
     /*
     * 碰撞检测
@@ -85,6 +200,29 @@ private:
     bool collisionDetect();
     BoundingBox transformBoundingBox(const BoundingBox& box, const glm::mat4& transform);
 
+    ObstacleBatch& getObstacleBatch(const std::shared_ptr<const Model>& mesh);
+
+    // the features lit meshes need with the current lights and material
+    ShaderVariants::Features getLitFeatures() const;
+
+    // render queue id of the variant, linked and registered on first use
+    uint8_t getSceneShaderId(ShaderVariants::Features features);
+
+    void uploadPhongUniforms(const GLSLProgram& shader, const PhongUniforms& uniforms);
+
+    // places the track lamps ahead of the camera and bins them into the clusters
+    void updateTrackLights();
+
+    // level of detail of the character for this frame
+    void selectCharacterLod();
+
+    // brings the cascades up to date, static casters only where they changed
+    void renderShadows();
+
+    void drawStaticShadowCasters(int cascade, const glm::mat4& lightViewProjection);
+
+    void uploadFrameUniforms();
+
     void handleInput() override;
 
     void renderFrame() override;
@@ -96,4 +234,8 @@ private:
     void testOn(); //test the export and import of obj loader
 
     void initModelResources();
+
+    // streams the terrain chunks around the camera, shadows cached over changed ones
+    // are invalidated
+    void streamTerrain();
 };
\ No newline at end of file
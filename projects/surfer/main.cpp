@@ -13,6 +13,7 @@ Options getOptions(int argc, char* argv[]) {
     options.glVersion = {3, 3};
     options.backgroundColor = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
     options.assetRootDir = "../../media/";
+    options.shaderCacheDir = "shader_cache/";
 
     return options;
 }
@@ -1,6 +1,6 @@
 #include "obstacle.h"
 
-const std::vector<Vertex> vertices = {
+const std::vector<Vertex> cubeVertices = {
         // Front
         {{-0.5f, -0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f}},
         {{0.5f, -0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}, {1.0f, 0.0f}},
@@ -15,7 +15,7 @@ const std::vector<Vertex> vertices = {
     };
 
     // Indices for drawing triangles
-const std::vector<uint32_t> indices = {
+const std::vector<uint32_t> cubeIndices = {
     // Front
     0, 1, 2,
     2, 3, 0,
@@ -41,84 +41,139 @@ const std::vector<uint32_t> indices = {
     6, 7, 3
 };
 
-Obstacle::Obstacle() {
-    // Vertices representing a cube
-    
+namespace {
+// below lodScreenSizes[l] viewport heights level l + 1 takes over, +- lodHysteresis
+const float lodScreenSizes[] = {0.1f, 0.035f};
+const float lodHysteresis = 0.2f;
 
-    // Set vertices and indices
-    _vertices = vertices;
-    _indices = indices;
+// sectors of the round primitives per level, spheres take half as many stacks
+const int sphereSectors[] = {100, 32, 12};
+const int roundSectors[] = {50, 24, 12};
+} // namespace
 
-    computeBoundingBox();
-    initGLResources();
-    initBoxGLResources();
-    this->transform = transform;
+Obstacle::Obstacle(MeshLibrary& library, int shape) : _shape(shape) {
+    _lodMeshes = acquireMeshes(library, shape);
+    if (shape == 1) {
+        _shapeInfo = 0.6f; // record radius
+    }
+}
+
+BoundingBox Obstacle::getBoundingBox() const {
+    return getMesh().getBoundingBox();
 }
 
-Obstacle::Obstacle(int shape):_shape(shape){
-    switch (shape)
-    {
-        case 0:
-            _vertices = vertices;
-            _indices = indices;
-            break;
-        case 1:
-            createSphere(0.6, 100, 50);
-            _shapeInfo = 0.6; //record radius
-            break; 
-        case 2:
-            createCylinder(0.7, 1.2, 50);
-            break;
-        case 3:
-            createCylinder(0.7, 1.2, 50);
-            break;
-        case 4:
-            createPrism(0.7, 1.3, 10);
-            break;
-        case 5:
-            createFrustum(0.3, 0.7, 1.3, 50);
-            break;
-        default:
-            break;
+const BoundingBox& Obstacle::getWorldBoundingBox() const {
+    if (_worldBoundingBoxVersion == transform.getVersion()) {
+        return _worldBoundingBox;
     }
-    computeBoundingBox();
-    initGLResources();
-    initBoxGLResources();
-    this->transform = transform;
+
+    _worldBoundingBox = getMesh().getBoundingBox().transform(transform.getLocalMatrix());
+    if (_shape == 1) {
+        // spheres collide by radius, the box must enclose the exact sphere as well
+        BoundingBox sphere;
+        sphere.min = transform.position - glm::vec3(_shapeInfo);
+        sphere.max = transform.position + glm::vec3(_shapeInfo);
+        _worldBoundingBox += sphere;
+    }
+    _worldBoundingBoxVersion = transform.getVersion();
+
+    return _worldBoundingBox;
 }
 
-Obstacle::Obstacle(Obstacle&& rhs):Model(std::move(rhs)){
-    transform = rhs.transform; //just copy 
-    _shape = rhs._shape;
-    _shapeInfo = rhs._shapeInfo;
-    initGLResources(); //gl resources have been freed 
+const Model& Obstacle::getMesh() const {
+    return *_lodMeshes.front();
+}
 
-    initBoxGLResources();
+size_t Obstacle::getLodCount() const {
+    return _lodMeshes.size();
 }
 
-Obstacle& Obstacle::operator=(Obstacle&& rhs) {
-    if (this != &rhs) {
-        Model::operator=(std::move(rhs)); // 移动赋值基类部分
+const Model& Obstacle::getLodMesh(size_t level) const {
+    return *_lodMeshes[level];
+}
 
-        _shape = rhs._shape;
-        transform = std::move(rhs.transform); // 移动赋值 transform
-        // 对于其他成员变量进行移动赋值操作（如果有）
+std::shared_ptr<const Model> Obstacle::getSharedLodMesh(size_t level) const {
+    return _lodMeshes[level];
+}
 
-        // 重新初始化 OpenGL 资源
-        initGLResources(); // 例如，重新初始化 _vao, _vbo, _ebo 等 OpenGL 资源
-        initBoxGLResources(); // 初始化 _boxVao, _boxVbo, _boxEbo 等
+size_t Obstacle::selectLod(float screenSize) {
+    while (_lod > 0 && screenSize > lodScreenSizes[_lod - 1] * (1.0f + lodHysteresis)) {
+        --_lod;
     }
-    return *this;
+    while (_lod + 1 < _lodMeshes.size()
+           && screenSize < lodScreenSizes[_lod] * (1.0f - lodHysteresis)) {
+        ++_lod;
+    }
+
+    return _lod;
 }
 
+void Obstacle::draw() const {
+    getMesh().draw();
+}
+
+std::vector<std::shared_ptr<const Model>> Obstacle::acquireMeshes(
+    MeshLibrary& library, int shape) {
+    // the key names the primitive together with its size and tessellation,
+    // per-obstacle length/height variation goes to transform.scale instead
+    std::vector<std::shared_ptr<const Model>> meshes;
+    switch (shape) {
+    case 1:
+        for (int sectors : sphereSectors) {
+            meshes.push_back(library.acquire(
+                "sphere:0.6:" + std::to_string(sectors) + "x" + std::to_string(sectors / 2),
+                [sectors](std::vector<Vertex>& v, std::vector<uint32_t>& i) {
+                    createSphere(0.6f, sectors, sectors / 2, v, i);
+                }));
+        }
+        break;
+    case 2:
+    case 3:
+        for (int sectors : roundSectors) {
+            meshes.push_back(library.acquire(
+                "cylinder:0.7x1.2:" + std::to_string(sectors),
+                [sectors](std::vector<Vertex>& v, std::vector<uint32_t>& i) {
+                    createCylinder(0.7f, 1.2f, sectors, v, i);
+                }));
+        }
+        break;
+    case 4:
+        meshes.push_back(library.acquire(
+            "prism:0.7x1.3:10", [](std::vector<Vertex>& v, std::vector<uint32_t>& i) {
+                createPrism(0.7f, 1.3f, 10, v, i);
+            }));
+        break;
+    case 5:
+        for (int sectors : roundSectors) {
+            meshes.push_back(library.acquire(
+                "frustum:0.3x0.7x1.3:" + std::to_string(sectors),
+                [sectors](std::vector<Vertex>& v, std::vector<uint32_t>& i) {
+                    createFrustum(0.3f, 0.7f, 1.3f, sectors, v, i);
+                }));
+        }
+        break;
+    default:
+        meshes.push_back(library.acquire("cube", createCube));
+        break;
+    }
+
+    return meshes;
+}
+
+void Obstacle::createCube(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+    vertices = cubeVertices;
+    indices = cubeIndices;
+}
 
 // Function to generate sphere vertices and indices
-void Obstacle::createSphere(float radius, int sectors, int stacks) {
+void Obstacle::createSphere(
+    float radius, int sectors, int stacks, std::vector<Vertex>& vertices,
+    std::vector<uint32_t>& indices) {
     int vertexCount = (sectors + 1) * (stacks + 1);
     int indexCount = sectors * stacks * 6;
 
-    int vIndex = 0, iIndex = 0;
-    Vertex vertex;
+    vertices.reserve(vertices.size() + vertexCount);
+    indices.reserve(indices.size() + indexCount);
 
     for (int i = 0; i <= stacks; ++i) {
         float stackAngle = static_cast<float>(M_PI / 2 - i * M_PI / stacks);
@@ -134,25 +189,27 @@ void Obstacle::createSphere(float radius, int sectors, int stacks) {
             glm::vec2 texCoord(static_cast<float>(j) / sectors, static_cast<float>(i) / stacks);
 
             Vertex vertex(position, normal, texCoord);
-            _vertices.push_back(vertex);
+            vertices.push_back(vertex);
 
             if (i < stacks && j < sectors) {
                 int currentRow = i * (sectors + 1);
                 int nextRow = (i + 1) * (sectors + 1);
 
-                _indices.push_back(currentRow + j);
-                _indices.push_back(nextRow + j);
-                _indices.push_back(currentRow + j + 1);
+                indices.push_back(currentRow + j);
+                indices.push_back(nextRow + j);
+                indices.push_back(currentRow + j + 1);
 
-                _indices.push_back(currentRow + j + 1);
-                _indices.push_back(nextRow + j);
-                _indices.push_back(nextRow + j + 1);
+                indices.push_back(currentRow + j + 1);
+                indices.push_back(nextRow + j);
+                indices.push_back(nextRow + j + 1);
             }
         }
     }
 }
 
-void Obstacle::createCylinder(float radius, float height, int sectors) {
+void Obstacle::createCylinder(
+    float radius, float height, int sectors, std::vector<Vertex>& vertices,
+    std::vector<uint32_t>& indices) {
     float sectorStep = 2.0f * M_PI / sectors;
 
     // Generate cylinder vertices
@@ -167,8 +224,8 @@ void Obstacle::createCylinder(float radius, float height, int sectors) {
 
         glm::vec2 texCoord(static_cast<float>(i) / sectors, 0.0f);
 
-        _vertices.emplace_back(positionTop, normal, texCoord);
-        _vertices.emplace_back(positionBottom, normal, texCoord);
+        vertices.emplace_back(positionTop, normal, texCoord);
+        vertices.emplace_back(positionBottom, normal, texCoord);
     }
 
     // Generate cylinder indices
@@ -176,18 +233,20 @@ void Obstacle::createCylinder(float radius, float height, int sectors) {
         int nextVertex = (i + 1) % sectors;
 
         // Top face
-        _indices.push_back(i * 2);
-        _indices.push_back(nextVertex * 2);
-        _indices.push_back(i * 2 + 1);
+        indices.push_back(i * 2);
+        indices.push_back(nextVertex * 2);
+        indices.push_back(i * 2 + 1);
 
         // Bottom face
-        _indices.push_back(nextVertex * 2 + 1);
-        _indices.push_back(nextVertex * 2);
-        _indices.push_back(i * 2 + 1);
+        indices.push_back(nextVertex * 2 + 1);
+        indices.push_back(nextVertex * 2);
+        indices.push_back(i * 2 + 1);
     }
 }
 
-void Obstacle::createCone(float radius, float height, int sectors) {
+void Obstacle::createCone(
+    float radius, float height, int sectors, std::vector<Vertex>& vertices,
+    std::vector<uint32_t>& indices) {
     float sectorStep = 2.0f * M_PI / sectors;
 
     // Apex vertex
@@ -204,7 +263,7 @@ void Obstacle::createCone(float radius, float height, int sectors) {
 
         glm::vec2 texCoord(static_cast<float>(i) / sectors, 0.0f);
 
-        _vertices.emplace_back(position, normal, texCoord);
+        vertices.emplace_back(position, normal, texCoord);
     }
 
     // Generate cone indices
@@ -212,18 +271,20 @@ void Obstacle::createCone(float radius, float height, int sectors) {
         int nextVertex = (i + 1) % sectors;
 
         // Base of the cone
-        _indices.push_back(i);
-        _indices.push_back(nextVertex);
-        _indices.push_back(static_cast<uint32_t>(_vertices.size()) / 2);
+        indices.push_back(i);
+        indices.push_back(nextVertex);
+        indices.push_back(static_cast<uint32_t>(vertices.size()) / 2);
 
         // Side faces
-        _indices.push_back(i);
-        _indices.push_back(nextVertex);
-        _indices.push_back(static_cast<uint32_t>(_vertices.size()) / 2 + 1);
+        indices.push_back(i);
+        indices.push_back(nextVertex);
+        indices.push_back(static_cast<uint32_t>(vertices.size()) / 2 + 1);
     }
 }
 
-void Obstacle::createPrism(float radius, float height, int sides) {
+void Obstacle::createPrism(
+    float radius, float height, int sides, std::vector<Vertex>& vertices,
+    std::vector<uint32_t>& indices) {
     float sectorStep = 2.0f * M_PI / sides;
 
     // Generate prism vertices
@@ -238,8 +299,8 @@ void Obstacle::createPrism(float radius, float height, int sides) {
 
         glm::vec2 texCoord(static_cast<float>(i) / sides, 0.0f);
 
-        _vertices.emplace_back(positionTop, normal, texCoord);
-        _vertices.emplace_back(positionBottom, normal, texCoord);
+        vertices.emplace_back(positionTop, normal, texCoord);
+        vertices.emplace_back(positionBottom, normal, texCoord);
     }
 
     // Generate prism indices
@@ -247,27 +308,29 @@ void Obstacle::createPrism(float radius, float height, int sides) {
         int nextVertex = (i + 1) % sides;
 
         // Top face
-        _indices.push_back(i * 2);
-        _indices.push_back(nextVertex * 2);
-        _indices.push_back(i * 2 + 1);
+        indices.push_back(i * 2);
+        indices.push_back(nextVertex * 2);
+        indices.push_back(i * 2 + 1);
 
         // Bottom face
-        _indices.push_back(nextVertex * 2 + 1);
-        _indices.push_back(nextVertex * 2);
-        _indices.push_back(i * 2 + 1);
+        indices.push_back(nextVertex * 2 + 1);
+        indices.push_back(nextVertex * 2);
+        indices.push_back(i * 2 + 1);
 
         // Side faces
-        _indices.push_back(i * 2);
-        _indices.push_back(nextVertex * 2);
-        _indices.push_back(nextVertex * 2 + 1);
+        indices.push_back(i * 2);
+        indices.push_back(nextVertex * 2);
+        indices.push_back(nextVertex * 2 + 1);
 
-        _indices.push_back(nextVertex * 2 + 1);
-        _indices.push_back(i * 2 + 1);
-        _indices.push_back(i * 2);
+        indices.push_back(nextVertex * 2 + 1);
+        indices.push_back(i * 2 + 1);
+        indices.push_back(i * 2);
     }
 }
 
-void Obstacle::createFrustum(float radiusTop, float radiusBottom, float height, int sectors) {
+void Obstacle::createFrustum(
+    float radiusTop, float radiusBottom, float height, int sectors,
+    std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
     float sectorStep = 2.0f * M_PI / sectors;
 
     // Generate frustum vertices
@@ -284,8 +347,8 @@ void Obstacle::createFrustum(float radiusTop, float radiusBottom, float height,
 
         glm::vec2 texCoord(static_cast<float>(i) / sectors, 0.0f);
 
-        _vertices.emplace_back(positionTop, normal, texCoord);
-        _vertices.emplace_back(positionBottom, normal, texCoord);
+        vertices.emplace_back(positionTop, normal, texCoord);
+        vertices.emplace_back(positionBottom, normal, texCoord);
     }
 
     // Generate frustum indices
@@ -293,22 +356,22 @@ void Obstacle::createFrustum(float radiusTop, float radiusBottom, float height,
         int nextVertex = (i + 1) % sectors;
 
         // Top face
-        _indices.push_back(i * 2);
-        _indices.push_back(nextVertex * 2);
-        _indices.push_back(i * 2 + 1);
+        indices.push_back(i * 2);
+        indices.push_back(nextVertex * 2);
+        indices.push_back(i * 2 + 1);
 
         // Bottom face
-        _indices.push_back(nextVertex * 2 + 1);
-        _indices.push_back(nextVertex * 2);
-        _indices.push_back(i * 2 + 1);
+        indices.push_back(nextVertex * 2 + 1);
+        indices.push_back(nextVertex * 2);
+        indices.push_back(i * 2 + 1);
 
         // Side faces
-        _indices.push_back(i * 2);
-        _indices.push_back(nextVertex * 2);
-        _indices.push_back(nextVertex * 2 + 1);
+        indices.push_back(i * 2);
+        indices.push_back(nextVertex * 2);
+        indices.push_back(nextVertex * 2 + 1);
 
-        _indices.push_back(nextVertex * 2 + 1);
-        _indices.push_back(i * 2 + 1);
-        _indices.push_back(i * 2);
+        indices.push_back(nextVertex * 2 + 1);
+        indices.push_back(i * 2 + 1);
+        indices.push_back(i * 2);
     }
 }
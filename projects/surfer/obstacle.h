@@ -1,10 +1,12 @@
 #pragma once
 #include <glm/vec3.hpp>
+#include "../base/mesh_library.h"
 #include "../base/model.h"
 #include "../base/vertex.h"
 
-#include <vector>
 #include <cmath>
+#include <memory>
+#include <vector>
 
 const std::vector<Vertex> sphereVertices = {
     // X      Y      Z
@@ -53,22 +55,62 @@ const std::vector<uint32_t> sphereIndices = {
         4, 0, 1
 };
 
-class Obstacle : public Model {
+class Obstacle {
 public:
-    Obstacle();
-    Obstacle(int shape);
-    Obstacle(Obstacle&& rhs);
-    Obstacle& operator=(Obstacle&& rhs);
-    //Obstacle(const Obstacle&) = delete; // 禁用拷贝构造函数
+    Obstacle(MeshLibrary& library, int shape = 0);
+
+    Transform transform;
     int _shape = 0;
     float _shapeInfo = 0;
-    bool operator<(const Obstacle& other) const {
-        return _vao < other._vao; // 或者使用其他逻辑来定义比较规则
-    }
+    uint64_t _id = 0; // assigned by the obstacle track
+
+    BoundingBox getBoundingBox() const;
+
+    // cached until the transform changes, static obstacles build it once
+    const BoundingBox& getWorldBoundingBox() const;
+
+    // the finest level, for collision, occlusion and bounds
+    const Model& getMesh() const;
+
+    // levels of detail, 0 is the finest. shapes that are exact at a few faces have one
+    size_t getLodCount() const;
+
+    const Model& getLodMesh(size_t level) const;
+
+    std::shared_ptr<const Model> getSharedLodMesh(size_t level) const;
+
+    // level for a projected size of screenSize viewport heights. a level is kept until
+    // the size leaves it by the hysteresis margin, so it does not flicker at a threshold
+    size_t selectLod(float screenSize);
+
+    void draw() const;
+
 private:
-    void createSphere(float radius, int sectors, int stacks);
-    void createCylinder(float radius, float height, int sectors);
-    void createCone(float radius, float height, int sectors);
-    void createPrism(float radius, float height, int sides);
-    void createFrustum(float radiusTop, float radiusBottom, float height, int sectors);
+    // shared geometry owned by the mesh library, finest first
+    std::vector<std::shared_ptr<const Model>> _lodMeshes;
+
+    mutable BoundingBox _worldBoundingBox;
+    mutable uint64_t _worldBoundingBoxVersion = 0;
+
+    size_t _lod = 0; // selected by the last selectLod()
+
+    static std::vector<std::shared_ptr<const Model>> acquireMeshes(
+        MeshLibrary& library, int shape);
+
+    static void createCube(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+    static void createSphere(
+        float radius, int sectors, int stacks, std::vector<Vertex>& vertices,
+        std::vector<uint32_t>& indices);
+    static void createCylinder(
+        float radius, float height, int sectors, std::vector<Vertex>& vertices,
+        std::vector<uint32_t>& indices);
+    static void createCone(
+        float radius, float height, int sectors, std::vector<Vertex>& vertices,
+        std::vector<uint32_t>& indices);
+    static void createPrism(
+        float radius, float height, int sides, std::vector<Vertex>& vertices,
+        std::vector<uint32_t>& indices);
+    static void createFrustum(
+        float radiusTop, float radiusBottom, float height, int sectors,
+        std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
 };
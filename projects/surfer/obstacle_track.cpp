@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <cassert>
+
+#include "obstacle_track.h"
+
+namespace {
+// obstacles whose position z lies in [zMin, zMax], z is descending along the container
+template <typename Iterator>
+ObstacleTrack::Range<Iterator> findWindow(Iterator begin, Iterator end, float zMin, float zMax) {
+    Iterator first = std::lower_bound(
+        begin, end, zMax,
+        [](const Obstacle& obstacle, float z) { return obstacle.transform.position.z > z; });
+    Iterator last = std::upper_bound(
+        first, end, zMin,
+        [](float z, const Obstacle& obstacle) { return z > obstacle.transform.position.z; });
+
+    return {first, last};
+}
+} // namespace
+
+const Obstacle& ObstacleTrack::push(Obstacle obstacle) {
+    assert(_obstacles.empty() || obstacle.transform.position.z <= back().transform.position.z);
+
+    const BoundingBox box = obstacle.getWorldBoundingBox();
+    const glm::vec3& position = obstacle.transform.position;
+    _maxReach = glm::max(_maxReach, glm::max(box.max - position, position - box.min));
+
+    // ids follow the order in the track, so find() is an index computation
+    obstacle._id = _nextId++;
+    _obstacles.push_back(std::move(obstacle));
+
+    return _obstacles.back();
+}
+
+size_t ObstacleTrack::popNear(float z, const std::function<void(const Obstacle&)>& onRemove) {
+    size_t count = 0;
+    while (!_obstacles.empty() && _obstacles.front().transform.position.z >= z) {
+        if (onRemove) {
+            onRemove(_obstacles.front());
+        }
+        _obstacles.pop_front();
+        ++count;
+    }
+
+    return count;
+}
+
+ObstacleTrack::Window ObstacleTrack::window(float zMin, float zMax) const {
+    return findWindow(_obstacles.cbegin(), _obstacles.cend(), zMin, zMax);
+}
+
+ObstacleTrack::MutableWindow ObstacleTrack::window(float zMin, float zMax) {
+    return findWindow(_obstacles.begin(), _obstacles.end(), zMin, zMax);
+}
+
+const Obstacle* ObstacleTrack::find(uint64_t id) const {
+    if (_obstacles.empty() || id < _obstacles.front()._id || id > _obstacles.back()._id) {
+        return nullptr;
+    }
+
+    return &_obstacles[static_cast<size_t>(id - _obstacles.front()._id)];
+}
+
+glm::vec3 ObstacleTrack::getMaxReach() const {
+    return _maxReach;
+}
+
+const Obstacle& ObstacleTrack::front() const {
+    return _obstacles.front();
+}
+
+const Obstacle& ObstacleTrack::back() const {
+    return _obstacles.back();
+}
+
+ObstacleTrack::ConstIterator ObstacleTrack::begin() const {
+    return _obstacles.begin();
+}
+
+ObstacleTrack::ConstIterator ObstacleTrack::end() const {
+    return _obstacles.end();
+}
+
+size_t ObstacleTrack::size() const {
+    return _obstacles.size();
+}
+
+bool ObstacleTrack::empty() const {
+    return _obstacles.empty();
+}
+
+void ObstacleTrack::clear() {
+    _obstacles.clear();
+    _maxReach = glm::vec3(0.0f);
+}
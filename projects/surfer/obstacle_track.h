@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+#include "obstacle.h"
+
+// live obstacles ordered by z, the near end (largest z, next to the camera) at the
+// front. the character runs towards -z, so new obstacles are appended at the far end
+// and passed ones leave from the near end, both in O(1)
+class ObstacleTrack {
+public:
+    using Container = std::deque<Obstacle>;
+    using Iterator = Container::iterator;
+    using ConstIterator = Container::const_iterator;
+
+    // contiguous run of obstacles, usable in a range-based for
+    template <typename It>
+    struct Range {
+        It first;
+        It last;
+
+        It begin() const {
+            return first;
+        }
+
+        It end() const {
+            return last;
+        }
+
+        bool empty() const {
+            return first == last;
+        }
+    };
+
+    using Window = Range<ConstIterator>;
+
+    // obstacles may be updated in place, e.g. their level of detail, but keep their z
+    using MutableWindow = Range<Iterator>;
+
+    // append at the far end, the z of obstacle must not exceed the z of the current back
+    const Obstacle& push(Obstacle obstacle);
+
+    // remove obstacles whose z >= z from the near end, return the number of removed ones
+    size_t popNear(float z, const std::function<void(const Obstacle&)>& onRemove = nullptr);
+
+    // obstacles whose position z lies in [zMin, zMax]
+    Window window(float zMin, float zMax) const;
+
+    MutableWindow window(float zMin, float zMax);
+
+    const Obstacle* find(uint64_t id) const;
+
+    // largest distance from an obstacle position to the faces of its world box, per axis
+    glm::vec3 getMaxReach() const;
+
+    const Obstacle& front() const;
+
+    const Obstacle& back() const;
+
+    ConstIterator begin() const;
+
+    ConstIterator end() const;
+
+    size_t size() const;
+
+    bool empty() const;
+
+    void clear();
+
+private:
+    Container _obstacles;
+    uint64_t _nextId = 0;
+    glm::vec3 _maxReach = glm::vec3(0.0f);
+};
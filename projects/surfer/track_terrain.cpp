@@ -0,0 +1,70 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "track_terrain.h"
+
+namespace {
+// obstacles reach about 10.5 units off the centre line
+const float trackHalfWidth = 12.0f;
+const float bankWidth = 10.0f;
+const float bankSlope = 0.15f;
+const float hillHeight = 18.0f;
+const float hillSize = 60.0f;
+const int hillOctaves = 4;
+
+// in [0, 1], the same for the same lattice point on every thread
+float hashLattice(int x, int z) {
+    uint32_t h = static_cast<uint32_t>(x) * 374761393u + static_cast<uint32_t>(z) * 668265263u;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    h ^= h >> 16;
+    return static_cast<float>(h) / 4294967295.0f;
+}
+
+float smooth(float t) {
+    return t * t * (3.0f - 2.0f * t);
+}
+
+// value noise in [0, 1], smoothly interpolated between the lattice points
+float valueNoise(float x, float z) {
+    const float fx = std::floor(x);
+    const float fz = std::floor(z);
+    const int ix = static_cast<int>(fx);
+    const int iz = static_cast<int>(fz);
+    const float u = smooth(x - fx);
+    const float v = smooth(z - fz);
+
+    const float lower = hashLattice(ix, iz) + u * (hashLattice(ix + 1, iz) - hashLattice(ix, iz));
+    const float upper =
+        hashLattice(ix, iz + 1) + u * (hashLattice(ix + 1, iz + 1) - hashLattice(ix, iz + 1));
+    return lower + v * (upper - lower);
+}
+
+// octaves of halving amplitude and doubling frequency, normalised to [0, 1]
+float fractalNoise(float x, float z) {
+    float sum = 0.0f;
+    float amplitude = 1.0f;
+    float total = 0.0f;
+    for (int octave = 0; octave < hillOctaves; ++octave) {
+        sum += amplitude * valueNoise(x, z);
+        total += amplitude;
+        amplitude *= 0.5f;
+        x *= 2.0f;
+        z *= 2.0f;
+    }
+
+    return sum / total;
+}
+} // namespace
+
+float getTrackTerrainHeight(float x, float z) {
+    const float side = std::abs(x) - trackHalfWidth;
+    if (side <= 0.0f) {
+        return 0.0f;
+    }
+
+    // the banks rise steadily away from the track, the hills on top of them fade in
+    // over the bank so the edge of the track stays level
+    const float bank = smooth(std::min(side / bankWidth, 1.0f));
+    return bank * (bankSlope * side + hillHeight * fractalNoise(x / hillSize, z / hillSize));
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+// height of the terrain at world x, z: flat across the track where the character runs and
+// the obstacles stand, banks rising on both sides into noise hills. thread safe
+float getTrackTerrainHeight(float x, float z);